@@ -8,7 +8,41 @@
 #include <random>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <functional>
 #include <string>
+#include <array>
+#include <utility>
+#include <type_traits>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <cmath>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Parallel execution policies need a backend library under libstdc++ (TBB),
+// so they are opt-in: build with -DSORTVIS_PARALLEL_STL and link -ltbb.
+#ifdef SORTVIS_PARALLEL_STL
+#include <execution>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SORTVIS_X86 1
+#include <immintrin.h>
+#endif
 
 const int WINDOW_WIDTH = 1000;
 const int WINDOW_HEIGHT = 600;
@@ -19,284 +53,5345 @@ const SDL_Color COLOR_BAR = {0, 153, 255, 255};
 const SDL_Color COLOR_COMPARE = {255, 153, 0, 255};
 const SDL_Color COLOR_SWAP = {255, 51, 51, 255};
 const SDL_Color COLOR_SORTED = {0, 255, 102, 255};
+const SDL_Color COLOR_BOUNDARY = {204, 51, 255, 255};
+
+// Per-worker colors for the parallel sorts.
+const SDL_Color THREAD_COLORS[] = {
+    {0, 204, 204, 255}, {255, 221, 0, 255}, {255, 105, 180, 255}, {160, 230, 60, 255},
+    {150, 110, 255, 255}, {255, 160, 122, 255}, {100, 180, 255, 255}, {220, 220, 220, 255},
+};
+const int THREAD_COLOR_COUNT = sizeof(THREAD_COLORS) / sizeof(THREAD_COLORS[0]);
+// Number of workers whose regions the parallel visualizations show.
+const int VIS_THREAD_COUNT = 4;
+
+enum SortType { BUBBLE, SELECTION, INSERTION, MERGE, QUICK, AMERICAN_FLAG, BITONIC, ODD_EVEN, PARALLEL_MERGE, SAMPLE, BLOCK_QUICK, SIMD_QUICK, CYCLE, COUNTING, BLOCK_MERGE, EXTERNAL, SHAKER, COMB, BINARY_INSERTION, SMOOTH, PATIENCE, THREE_WAY_QUICK, INTRO_SELECT, HEAP_TOP_K, PARTIAL_QUICK, MERGE_INSERTION, FLASH, FUNNEL, STD_SORT, STD_STABLE_SORT, STD_PAR_SORT, SORT_COUNT };
+const char* SORT_NAMES[] = {"Bubble Sort", "Selection Sort", "Insertion Sort", "Merge Sort", "Quick Sort", "American Flag Sort", "Bitonic Sort",
+                            "Odd-Even Transposition Sort", "Parallel Merge Sort", "Parallel Sample Sort", "Block Quick Sort", "SIMD Quick Sort", "Cycle Sort", "Counting Sort", "Block Merge Sort", "External Merge Sort", "Cocktail Shaker Sort", "Comb Sort", "Binary Insertion Sort", "Smoothsort", "Patience Sort", "3-Way Quick Sort", "Introselect", "Heap Top-K", "Partial Quick Sort", "Merge-Insertion Sort", "Flashsort", "Funnelsort", "std::sort", "std::stable_sort",
+                            "std::sort (par_unseq)"};
+
+// American flag sort: digit width used by the visualizer (small so several
+// levels of buckets are visible on 100 bars) and by the plain kernel.
+const int FLAG_VIS_RADIX_BITS = 2;
+const int FLAG_RADIX_BITS = 8;
+const int FLAG_MAX_BUCKETS = 1 << FLAG_RADIX_BITS;
+const int FLAG_INSERTION_CUTOFF = 16;
+const int FLAG_VIS_INSERTION_CUTOFF = 4;
+
+// Block quick sort: offsets per block (fits the unsigned char offset buffers)
+// and the smaller block used on screen so several blocks fit in one range.
+const int BLOCKQS_BLOCK = 64;
+const int BLOCKQS_VIS_BLOCK = 8;
+const int QUICK_INSERTION_CUTOFF = 16;
+// Distinct keys on screen in the few-unique input (U key).
+const int FEW_UNIQUE_KEYS = 5;
 
-enum SortType { BUBBLE, SELECTION, INSERTION, MERGE, QUICK, SORT_COUNT };
-const char* SORT_NAMES[] = {"Bubble Sort", "Selection Sort", "Insertion Sort", "Merge Sort", "Quick Sort"};
+// The selection modes stop once their target is in place: Introselect finds
+// the median, Heap Top-K and Partial Quick Sort the smallest tenth in order.
+// They are not full sorts.
+inline bool isSelectionMode(SortType type) { return type == INTRO_SELECT || type == HEAP_TOP_K || type == PARTIAL_QUICK; }
+inline int selectionTarget(SortType type, int n) { return type == INTRO_SELECT ? n / 2 : (n + 9) / 10; }
+
+// The standard library sorts are baselines for the others; the visualizer
+// runs them whole, at full speed, in a single step.
+inline bool isReferenceSort(SortType type) { return type == STD_SORT || type == STD_STABLE_SORT || type == STD_PAR_SORT; }
 
 struct Bar {
     int value;
     SDL_Color color;
 };
 
-class SortingVisualizer {
-public:
-    SortingVisualizer();
-    ~SortingVisualizer();
-    bool init();
-    void run();
-
-private:
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    std::vector<Bar> bars;
-    int speed;
-    SortType currentSort;
-    bool sorting;
-    bool paused;
-    bool sorted;
-
-    void resetBars();
-    void shuffleBars();
-    void drawBars();
-    void handleEvents();
-    void sortStep();
-
-    // Sorting helpers
-    int bubble_i, bubble_j;
-    int selection_i, selection_j, selection_min;
-    int insertion_i, insertion_j;
-    int merge_size;
-    std::vector<std::pair<int, int>> quick_stack;
+inline int keyOf(int v) { return v; }
+inline int keyOf(const Bar& b) { return b.value; }
 
-    void initSortState();
-    void bubbleSortStep();
-    void selectionSortStep();
-    void insertionSortStep();
-    void mergeSortStep();
-    void quickSortStep();
+// Key order for the standard library algorithms; a function object so that
+// the comparison inlines.
+struct KeyLess {
+    template <typename T>
+    bool operator()(const T& x, const T& y) const {
+        return keyOf(x) < keyOf(y);
+    }
 };
 
-SortingVisualizer::SortingVisualizer() :
-    window(nullptr), renderer(nullptr), speed(15), currentSort(BUBBLE), sorting(false), paused(false), sorted(false) {}
+// Sorting kernels
+// Shared by the step functions (on Bars) and usable on plain int arrays.
 
-SortingVisualizer::~SortingVisualizer() {
-    if (renderer) SDL_DestroyRenderer(renderer);
-    if (window) SDL_DestroyWindow(window);
-    SDL_Quit();
+template <typename T>
+void insertionSortRange(T* a, int n) {
+    for (int i = 1; i < n; ++i) {
+        T x = a[i];
+        int j = i;
+        while (j > 0 && keyOf(a[j - 1]) > keyOf(x)) {
+            a[j] = a[j - 1];
+            --j;
+        }
+        a[j] = x;
+    }
 }
 
-bool SortingVisualizer::init() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) return false;
-    window = SDL_CreateWindow("Sorting Visualizer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE);
-    if (!window) return false;
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) return false;
-    resetBars();
-    return true;
+// First index in the sorted a[lo, hi) whose key is not below (lower bound)
+// or is above (upper bound) the key of x.
+template <typename T>
+int lowerBoundKey(const T* a, int lo, int hi, const T& x) {
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (keyOf(a[mid]) < keyOf(x)) lo = mid + 1; else hi = mid;
+    }
+    return lo;
 }
 
-void SortingVisualizer::resetBars() {
-    bars.clear();
-    for (int i = 0; i < BAR_COUNT; ++i) {
-        bars.push_back({ (i + 1), COLOR_BAR });
+template <typename T>
+int upperBoundKey(const T* a, int lo, int hi, const T& x) {
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (keyOf(x) < keyOf(a[mid])) hi = mid; else lo = mid + 1;
     }
-    shuffleBars();
-    sorted = false;
-    sorting = false;
-    paused = false;
-    initSortState();
+    return lo;
 }
 
-void SortingVisualizer::shuffleBars() {
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(bars.begin(), bars.end(), g);
+template <typename T>
+inline void compareExchange(T& x, T& y) {
+    if (keyOf(y) < keyOf(x)) std::swap(x, y);
 }
 
-void SortingVisualizer::drawBars() {
-    SDL_SetRenderDrawColor(renderer, COLOR_BG.r, COLOR_BG.g, COLOR_BG.b, COLOR_BG.a);
-    SDL_RenderClear(renderer);
-    int w, h;
-    SDL_GetWindowSize(window, &w, &h);
-    int barW = w / BAR_COUNT;
-    for (int i = 0; i < BAR_COUNT; ++i) {
-        SDL_Rect rect = { i * barW, h - (bars[i].value * (h - 40) / BAR_COUNT), barW - 1, (bars[i].value * (h - 40) / BAR_COUNT) };
-        SDL_SetRenderDrawColor(renderer, bars[i].color.r, bars[i].color.g, bars[i].color.b, bars[i].color.a);
-        SDL_RenderFillRect(renderer, &rect);
-    }
-    SDL_RenderPresent(renderer);
+inline void compareExchange(int& x, int& y) {
+    int lo = std::min(x, y), hi = std::max(x, y);
+    x = lo;
+    y = hi;
 }
 
-void SortingVisualizer::handleEvents() {
-    SDL_Event e;
-    while (SDL_PollEvent(&e)) {
-        if (e.type == SDL_QUIT) {
-            exit(0);
-        } else if (e.type == SDL_KEYDOWN) {
-            switch (e.key.keysym.sym) {
-                case SDLK_ESCAPE: exit(0); break;
-                case SDLK_SPACE: sorting = !sorting; break;
-                case SDLK_r: resetBars(); break;
-                case SDLK_s: shuffleBars(); sorted = false; sorting = false; paused = false; initSortState(); break;
-                case SDLK_RIGHT: currentSort = (SortType)((currentSort + 1) % SORT_COUNT); resetBars(); break;
-                case SDLK_LEFT: currentSort = (SortType)((currentSort - 1 + SORT_COUNT) % SORT_COUNT); resetBars(); break;
-                case SDLK_UP: speed = std::max(1, speed - 5); break;
-                case SDLK_DOWN: speed = std::min(100, speed + 5); break;
-                case SDLK_p: paused = !paused; break;
+// Sorting networks for small base cases
+// Sizes 2-8 use the best known (size-optimal) networks; 9 up to
+// SORTING_NETWORK_MAX use Batcher's odd-even merge network. Every network is
+// built at compile time and applied fully unrolled, and networkSort picks
+// one from a table indexed by n. Networks are not stable, so only plain
+// keys get them as a base case (see smallSort).
+const int SORTING_NETWORK_MAX = 32;
+
+struct Comparator {
+    int i, j;
+};
+
+constexpr Comparator SMALL_NETWORKS[] = {
+    {0, 1},
+    {0, 2}, {0, 1}, {1, 2},
+    {0, 2}, {1, 3}, {0, 1}, {2, 3}, {1, 2},
+    {0, 3}, {1, 4}, {0, 2}, {1, 3}, {0, 1}, {2, 4}, {1, 2}, {3, 4}, {2, 3},
+    {0, 5}, {1, 3}, {2, 4}, {1, 2}, {3, 4}, {0, 3}, {2, 5}, {0, 1}, {2, 3}, {4, 5}, {1, 2}, {3, 4},
+    {0, 6}, {2, 3}, {4, 5}, {0, 2}, {1, 4}, {3, 6}, {0, 1}, {2, 5}, {3, 4}, {1, 2}, {4, 6}, {2, 3}, {4, 5}, {1, 2}, {3, 4}, {5, 6},
+    {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 1}, {2, 3}, {4, 5}, {6, 7}, {2, 4}, {3, 5}, {1, 4}, {3, 6}, {1, 2}, {3, 4}, {5, 6},
+};
+// SMALL_NETWORKS[SMALL_NETWORK_OFFSET[n] .. SMALL_NETWORK_OFFSET[n + 1]) sorts n inputs.
+constexpr int SMALL_NETWORK_OFFSET[] = {0, 0, 0, 1, 4, 9, 18, 30, 46, 65};
+
+// Batcher's odd-even merge sort for any n, visiting comparators in order.
+template <typename F>
+constexpr void forEachBatcherComparator(int n, F&& f) {
+    for (int p = 1; p < n; p *= 2) {
+        for (int k = p; k >= 1; k /= 2) {
+            for (int j = k % p; j + k < n; j += 2 * k) {
+                for (int i = 0; i < std::min(k, n - j - k); ++i) {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) f(i + j, i + j + k);
+                }
             }
         }
     }
 }
 
-void SortingVisualizer::initSortState() {
-    bubble_i = bubble_j = 0;
-    selection_i = selection_j = selection_min = 0;
-    insertion_i = 1; insertion_j = 0;
-    merge_size = 1;
-    quick_stack.clear();
-    quick_stack.push_back({0, BAR_COUNT - 1});
+constexpr int sortingNetworkSize(int n) {
+    if (n <= 8) return SMALL_NETWORK_OFFSET[n + 1] - SMALL_NETWORK_OFFSET[n];
+    int count = 0;
+    forEachBatcherComparator(n, [&count](int, int) { ++count; });
+    return count;
 }
 
-void SortingVisualizer::sortStep() {
-    switch (currentSort) {
-        case BUBBLE: bubbleSortStep(); break;
-        case SELECTION: selectionSortStep(); break;
-        case INSERTION: insertionSortStep(); break;
-        case MERGE: mergeSortStep(); break;
-        case QUICK: quickSortStep(); break;
-        default: break;
+template <int N>
+constexpr std::array<Comparator, sortingNetworkSize(N)> makeSortingNetwork() {
+    std::array<Comparator, sortingNetworkSize(N)> net{};
+    if (N <= 8) {
+        for (int c = 0; c < sortingNetworkSize(N); ++c) net[c] = SMALL_NETWORKS[SMALL_NETWORK_OFFSET[N] + c];
+    } else {
+        int c = 0;
+        forEachBatcherComparator(N, [&net, &c](int i, int j) { net[c++] = {i, j}; });
     }
+    return net;
 }
 
-void SortingVisualizer::bubbleSortStep() {
-    if (bubble_i < BAR_COUNT - 1) {
-        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
-        bars[bubble_j].color = COLOR_COMPARE;
-        bars[bubble_j + 1].color = COLOR_COMPARE;
-        if (bars[bubble_j].value > bars[bubble_j + 1].value) {
-            std::swap(bars[bubble_j], bars[bubble_j + 1]);
-            bars[bubble_j].color = COLOR_SWAP;
-            bars[bubble_j + 1].color = COLOR_SWAP;
-        }
-        if (++bubble_j >= BAR_COUNT - bubble_i - 1) {
-            ++bubble_i;
-            bubble_j = 0;
-        }
+template <int N>
+struct SortingNetwork {
+    static constexpr auto comparators = makeSortingNetwork<N>();
+};
+
+template <int N, typename T, std::size_t... I>
+inline void applySortingNetwork(T* a, std::index_sequence<I...>) {
+    (void)a;  // unused by the empty networks for n < 2
+    (compareExchange(a[SortingNetwork<N>::comparators[I].i], a[SortingNetwork<N>::comparators[I].j]), ...);
+}
+
+template <int N, typename T>
+void sortingNetwork(T* a) {
+    applySortingNetwork<N>(a, std::make_index_sequence<SortingNetwork<N>::comparators.size()>{});
+}
+
+template <typename T, std::size_t... N>
+constexpr std::array<void (*)(T*), sizeof...(N)> sortingNetworkTable(std::index_sequence<N...>) {
+    return {{&sortingNetwork<(int)N, T>...}};
+}
+
+// Sorts a[0..n) for n <= SORTING_NETWORK_MAX.
+template <typename T>
+void networkSort(T* a, int n) {
+    static constexpr auto table = sortingNetworkTable<T>(std::make_index_sequence<SORTING_NETWORK_MAX + 1>{});
+    table[n](a);
+}
+
+// Base case for the recursive kernels: stable insertion sort in general,
+// a sorting network for plain keys.
+template <typename T>
+void smallSort(T* a, int n) {
+    insertionSortRange(a, n);
+}
+
+inline void smallSort(int* a, int n) {
+    if (n <= SORTING_NETWORK_MAX) {
+        networkSort(a, n);
     } else {
-        for (auto& bar : bars) bar.color = COLOR_SORTED;
-        sorted = true;
-        sorting = false;
+        insertionSortRange(a, n);
     }
 }
 
-void SortingVisualizer::selectionSortStep() {
-    if (selection_i < BAR_COUNT - 1) {
-        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
-        selection_min = selection_i;
-        for (int j = selection_i + 1; j < BAR_COUNT; ++j) {
-            bars[j].color = COLOR_COMPARE;
-            if (bars[j].value < bars[selection_min].value) {
-                selection_min = j;
+// Keys are radix-sorted as unsigned with the sign bit flipped so negative
+// values order correctly.
+template <typename T>
+inline unsigned radixKey(const T& x) { return (unsigned)keyOf(x) ^ 0x80000000u; }
+
+struct RadixRange {
+    int l, r;   // half-open [l, r)
+    int shift;  // bit offset of the digit to distribute on
+};
+
+// Shift of the most significant digit that differs anywhere in a[0..n),
+// or -1 when all keys are equal. Skips passes over common leading digits.
+template <typename T>
+int radixStartShift(const T* a, int n, int bits) {
+    if (n < 2) return -1;
+    unsigned lo = radixKey(a[0]), hi = lo;
+    for (int i = 1; i < n; ++i) {
+        lo = std::min(lo, radixKey(a[i]));
+        hi = std::max(hi, radixKey(a[i]));
+    }
+    unsigned diff = lo ^ hi;
+    if (diff == 0) return -1;
+    int top = 31;
+    while (!(diff >> top)) --top;
+    return (top / bits) * bits;
+}
+
+// One American flag pass: permutes a[0..n) in place into buckets by the digit
+// at `shift`, moving each element straight to its bucket by cycle-leader
+// swaps. bucketEnd[d] receives the (exclusive) end of bucket d.
+template <typename T>
+void americanFlagPass(T* a, int n, int shift, int bits, int* bucketEnd) {
+    const int buckets = 1 << bits;
+    const unsigned mask = buckets - 1;
+    int head[FLAG_MAX_BUCKETS] = {};
+    for (int i = 0; i < n; ++i) ++head[(radixKey(a[i]) >> shift) & mask];
+    int sum = 0;
+    for (int d = 0; d < buckets; ++d) {
+        int c = head[d];
+        head[d] = sum;
+        sum += c;
+        bucketEnd[d] = sum;
+    }
+    for (int d = 0; d < buckets; ++d) {
+        while (head[d] < bucketEnd[d]) {
+            T v = a[head[d]];
+            int dv = (radixKey(v) >> shift) & mask;
+            while (dv != d) {
+                std::swap(v, a[head[dv]++]);
+                dv = (radixKey(v) >> shift) & mask;
             }
+            a[head[d]++] = v;
         }
-        std::swap(bars[selection_i], bars[selection_min]);
-        bars[selection_i].color = COLOR_SWAP;
-        ++selection_i;
-    } else {
-        for (auto& bar : bars) bar.color = COLOR_SORTED;
-        sorted = true;
-        sorting = false;
     }
 }
 
-void SortingVisualizer::insertionSortStep() {
-    if (insertion_i < BAR_COUNT) {
-        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
-        int j = insertion_i;
-        while (j > 0 && bars[j - 1].value > bars[j].value) {
-            std::swap(bars[j], bars[j - 1]);
-            bars[j].color = COLOR_SWAP;
-            bars[j - 1].color = COLOR_SWAP;
-            --j;
+// In-place MSD radix sort. Aux memory is the bucket tables of one pass plus
+// an explicit range stack, independent of n.
+template <typename T>
+void americanFlagSort(T* a, int n, int bits = FLAG_RADIX_BITS, int cutoff = FLAG_INSERTION_CUTOFF) {
+    int shift = radixStartShift(a, n, bits);
+    if (shift < 0) return;
+    std::vector<RadixRange> stack;
+    stack.push_back({0, n, shift});
+    int ends[FLAG_MAX_BUCKETS];
+    while (!stack.empty()) {
+        RadixRange range = stack.back();
+        stack.pop_back();
+        int size = range.r - range.l;
+        if (size <= cutoff) {
+            insertionSortRange(a + range.l, size);
+            continue;
+        }
+        americanFlagPass(a + range.l, size, range.shift, bits, ends);
+        if (range.shift == 0) continue;
+        for (int d = (1 << bits) - 1, end = size; d >= 0; --d) {
+            int begin = d > 0 ? ends[d - 1] : 0;
+            if (end - begin > 1) stack.push_back({range.l + begin, range.l + end, range.shift - bits});
+            end = begin;
         }
-        bars[insertion_i].color = COLOR_COMPARE;
-        ++insertion_i;
-    } else {
-        for (auto& bar : bars) bar.color = COLOR_SORTED;
-        sorted = true;
-        sorting = false;
     }
 }
 
-void SortingVisualizer::mergeSortStep() {
-    if (merge_size < BAR_COUNT) {
-        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
-        int left = 0;
-        while (left < BAR_COUNT) {
-            int mid = std::min(left + merge_size - 1, BAR_COUNT - 1);
-            int right = std::min(left + 2 * merge_size - 1, BAR_COUNT - 1);
-            int n1 = mid - left + 1;
-            int n2 = right - mid;
-            std::vector<Bar> L(bars.begin() + left, bars.begin() + mid + 1);
-            std::vector<Bar> R(bars.begin() + mid + 1, bars.begin() + right + 1);
-            int i = 0, j = 0, k = left;
-            while (i < n1 && j < n2) {
-                bars[k].color = COLOR_COMPARE;
-                if (L[i].value <= R[j].value) {
-                    bars[k++] = L[i++];
-                } else {
-                    bars[k++] = R[j++];
-                }
-            }
-            while (i < n1) bars[k++] = L[i++];
-            while (j < n2) bars[k++] = R[j++];
-            left += 2 * merge_size;
+// Plain versions of the step-based quick and merge sorts, used as the branchy
+// reference points in benchmarks.
+template <typename T>
+void lomutoQuickSort(T* a, int n) {
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back({0, n - 1});
+    while (!stack.empty()) {
+        int l = stack.back().first, r = stack.back().second;
+        stack.pop_back();
+        if (l >= r) continue;
+        int pivot = keyOf(a[r]);
+        int i = l - 1;
+        for (int j = l; j < r; ++j) {
+            if (keyOf(a[j]) < pivot) std::swap(a[++i], a[j]);
         }
-        merge_size *= 2;
-    } else {
-        for (auto& bar : bars) bar.color = COLOR_SORTED;
-        sorted = true;
-        sorting = false;
+        std::swap(a[i + 1], a[r]);
+        stack.push_back({l, i});
+        stack.push_back({i + 2, r});
     }
 }
 
-void SortingVisualizer::quickSortStep() {
-    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
-    if (!quick_stack.empty()) {
-        auto& top = quick_stack.back();
-        int l = top.first, r = top.second;
-        if (l < r) {
-            int pivot = bars[r].value;
-            int i = l - 1;
-            for (int j = l; j < r; ++j) {
-                bars[j].color = COLOR_COMPARE;
-                if (bars[j].value < pivot) {
-                    ++i;
-                    std::swap(bars[i], bars[j]);
-                    bars[i].color = COLOR_SWAP;
-                    bars[j].color = COLOR_SWAP;
-                }
+// Plain versions of the original step-based sorts, used for cost measurement.
+// Bubble sort stops after a pass without swaps, and each pass ends at the
+// previous pass's last swap since everything after it is already final.
+template <typename T>
+void bubbleSort(T* a, int n) {
+    for (int bound = n - 1; bound > 0;) {
+        int last = 0;
+        for (int j = 0; j < bound; ++j) {
+            if (keyOf(a[j]) > keyOf(a[j + 1])) {
+                std::swap(a[j], a[j + 1]);
+                last = j;
             }
-            std::swap(bars[i + 1], bars[r]);
-            bars[i + 1].color = COLOR_SWAP;
-            quick_stack.pop_back();
-            quick_stack.push_back({l, i});
-            quick_stack.push_back({i + 2, r});
-        } else {
-            quick_stack.pop_back();
         }
-    } else {
-        for (auto& bar : bars) bar.color = COLOR_SORTED;
-        sorted = true;
-        sorting = false;
+        bound = last;
     }
 }
 
-void SortingVisualizer::run() {
-    while (true) {
-        handleEvents();
-        if (sorting && !paused && !sorted) {
-            sortStep();
-            drawBars();
-            SDL_Delay(speed);
-        } else {
-            drawBars();
-            SDL_Delay(10);
+// The textbook version that always makes all n - 1 passes, as a benchmark
+// reference.
+template <typename T>
+void bubbleSortAllPasses(T* a, int n) {
+    for (int i = 0; i < n - 1; ++i) {
+        for (int j = 0; j < n - i - 1; ++j) {
+            if (keyOf(a[j]) > keyOf(a[j + 1])) std::swap(a[j], a[j + 1]);
         }
     }
 }
 
-int main(int argc, char* argv[]) {
+// Bubble passes alternating direction, each shrinking its end of the range
+// to the last swap. Small elements near the end ("turtles") travel all the
+// way back in one backward pass instead of one position per pass.
+template <typename T>
+void cocktailShakerSort(T* a, int n) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int last = lo;
+        for (int j = lo; j < hi; ++j) {
+            if (keyOf(a[j]) > keyOf(a[j + 1])) {
+                std::swap(a[j], a[j + 1]);
+                last = j;
+            }
+        }
+        hi = last;
+        last = hi;
+        for (int j = hi; j > lo; --j) {
+            if (keyOf(a[j - 1]) > keyOf(a[j])) {
+                std::swap(a[j - 1], a[j]);
+                last = j;
+            }
+        }
+        lo = last;
+    }
+}
+
+// Comb sort: bubble passes over pairs `gap` apart, the gap shrinking by
+// 1.3 each pass (with 9 and 10 rounded to 11) until gap-1 passes find
+// nothing to swap.
+inline int nextCombGap(int gap) {
+    gap = gap * 10 / 13;
+    if (gap == 9 || gap == 10) return 11;
+    return std::max(1, gap);
+}
+
+template <typename T>
+void combSort(T* a, int n) {
+    bool swapped = true;
+    for (int gap = n; gap > 1 || swapped;) {
+        gap = nextCombGap(gap);
+        swapped = false;
+        for (int i = 0; i + gap < n; ++i) {
+            if (keyOf(a[i]) > keyOf(a[i + gap])) {
+                std::swap(a[i], a[i + gap]);
+                swapped = true;
+            }
+        }
+    }
+}
+
+template <typename T>
+void selectionSort(T* a, int n) {
+    for (int i = 0; i < n - 1; ++i) {
+        int min = i;
+        for (int j = i + 1; j < n; ++j) {
+            if (keyOf(a[j]) < keyOf(a[min])) min = j;
+        }
+        std::swap(a[i], a[min]);
+    }
+}
+
+template <typename T>
+void insertionSortSwaps(T* a, int n) {
+    for (int i = 1; i < n; ++i) {
+        for (int j = i; j > 0 && keyOf(a[j - 1]) > keyOf(a[j]); --j) std::swap(a[j], a[j - 1]);
+    }
+}
+
+// Binary insertion sort: the insertion point is an upper-bound binary search
+// of the sorted prefix (so equal keys stay in order), and the prefix tail
+// moves up one place as a single block move, a memmove for plain keys. Each
+// element is written once instead of once per position it sinks.
+template <typename T>
+void binaryInsertionSort(T* a, int n) {
+    for (int i = 1; i < n; ++i) {
+        int pos = upperBoundKey(a, 0, i, a[i]);
+        if (pos == i) continue;
+        T x = a[i];
+        std::move_backward(a + pos, a + i, a + i + 1);
+        a[pos] = x;
+    }
+}
+
+// Merge-insertion sort (Ford & Johnson) spends as few comparisons as it can,
+// close to the log2(n!) lower bound, and pays for it in moves. Elements are
+// compared in pairs, the larger of each pair (a_1 <= ... <= a_h) are sorted
+// recursively, and the smaller ones (b_j < a_j) are binary-inserted into the
+// chain b_1 a_1 ... a_h in Jacobsthal-numbered groups (b_3 b_2, b_5 b_4,
+// b_11 ... b_6, ...). Each b_j is searched only in the chain before a_j,
+// which the group order keeps at 2^k - 1 elements, so no probe is wasted.
+
+// The order the pending b_2 ... b_count are inserted in (b_1 needs none).
+inline std::vector<int> jacobsthalOrder(int count) {
+    std::vector<int> order;
+    for (int prev = 1, power = 4; prev < count; power *= 2) {
+        int next = power - prev;
+        for (int j = std::min(next, count); j > prev; --j) order.push_back(j);
+        prev = next;
+    }
+    return order;
+}
+
+// Returns the positions in items of their elements in sorted order.
+template <typename T>
+std::vector<int> mergeInsertionOrder(const T* a, const std::vector<int>& items) {
+    int m = (int)items.size(), half = m / 2;
+    if (m < 2) return std::vector<int>(m, 0);
+    std::vector<int> winners(half), winPos(half), losePos(half);
+    for (int i = 0; i < half; ++i) {
+        bool second = keyOf(a[items[2 * i]]) < keyOf(a[items[2 * i + 1]]);
+        winPos[i] = 2 * i + second;
+        losePos[i] = 2 * i + !second;
+        winners[i] = items[winPos[i]];
+    }
+    std::vector<int> order = mergeInsertionOrder(a, winners);
+    std::vector<int> chain;
+    chain.reserve(m);
+    chain.push_back(losePos[order[0]]);
+    for (int p : order) chain.push_back(winPos[p]);
+    for (int j : jacobsthalOrder(half + m % 2)) {
+        int pos = j <= half ? losePos[order[j - 1]] : m - 1;
+        int hi = j <= half ? (int)(std::find(chain.begin(), chain.end(), winPos[order[j - 1]]) - chain.begin()) : (int)chain.size();
+        int lo = 0;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (keyOf(a[items[pos]]) < keyOf(a[items[chain[mid]]])) hi = mid; else lo = mid + 1;
+        }
+        chain.insert(chain.begin() + lo, pos);
+    }
+    return chain;
+}
+
+// ceil(log2(n!)): the fewest comparisons that can sort every input of n keys.
+inline long long comparisonLowerBound(int n) {
+    double bits = 0;
+    for (int k = 2; k <= n; ++k) bits += std::log2((double)k);
+    return (long long)std::ceil(bits - 1e-9);
+}
+
+template <typename T>
+void mergeInsertionSort(T* a, int n) {
+    std::vector<int> items(n);
+    for (int i = 0; i < n; ++i) items[i] = i;
+    std::vector<T> out;
+    out.reserve(n);
+    for (int p : mergeInsertionOrder(a, items)) out.push_back(a[p]);
+    std::copy(out.begin(), out.end(), a);
+}
+
+// Cycle sort: each element is written at most once, straight into its final
+// position, which is the minimum possible number of writes. Places the cycle
+// that starts at `start`, given that a[0..start) is already final.
+template <typename T>
+void cycleSortCycle(T* a, int n, int start) {
+    T item = a[start];
+    int pos = start;
+    for (int i = start + 1; i < n; ++i) {
+        if (keyOf(a[i]) < keyOf(item)) ++pos;
+    }
+    if (pos == start) return;
+    while (keyOf(item) == keyOf(a[pos])) ++pos;
+    std::swap(item, a[pos]);
+    while (pos != start) {
+        pos = start;
+        for (int i = start + 1; i < n; ++i) {
+            if (keyOf(a[i]) < keyOf(item)) ++pos;
+        }
+        while (keyOf(item) == keyOf(a[pos])) ++pos;
+        std::swap(item, a[pos]);
+    }
+}
+
+template <typename T>
+void cycleSort(T* a, int n) {
+    for (int start = 0; start < n - 1; ++start) cycleSortCycle(a, n, start);
+}
+
+// Moves the median of a[l], a[(l + r) / 2] and a[r] to a[r] as the pivot.
+template <typename T>
+void medianOfThreeToEnd(T* a, int l, int r) {
+    int m = l + (r - l) / 2;
+    if (keyOf(a[m]) < keyOf(a[l])) std::swap(a[m], a[l]);
+    if (keyOf(a[r]) < keyOf(a[l])) std::swap(a[r], a[l]);
+    if (keyOf(a[m]) < keyOf(a[r])) std::swap(a[m], a[r]);
+}
+
+// Quick sort driver shared by the partition schemes: median-of-three pivot
+// moved to the end, smaller side handled first, ranges of at most `cutoff`
+// elements finished by `base(a, n)`. `partition(a, l, r)` partitions
+// [l, r] around a[r] and returns the pivot's final index. A strict `< pivot`
+// partition leaves every key equal to the pivot on one side, so when the
+// pivot equals the key just left of the range (an earlier pivot, which no
+// key in the range is below) its copies are gathered at the front and
+// skipped instead; few distinct keys then cost a linear pass each rather
+// than quadratic time.
+template <typename T, typename Partition, typename BaseCase>
+void quickSortWith(T* a, int n, Partition partition, int cutoff, BaseCase base) {
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back({0, n - 1});
+    while (!stack.empty()) {
+        int l = stack.back().first, r = stack.back().second;
+        stack.pop_back();
+        if (r - l + 1 <= std::max(cutoff, 2)) {
+            if (r > l) base(a + l, r - l + 1);
+            continue;
+        }
+        medianOfThreeToEnd(a, l, r);
+        if (l > 0 && !(keyOf(a[l - 1]) < keyOf(a[r]))) {
+            int pivot = keyOf(a[r]), m = l;
+            for (int j = l; j <= r; ++j) {
+                if (!(pivot < keyOf(a[j]))) std::swap(a[m++], a[j]);
+            }
+            stack.push_back({m, r});
+            continue;
+        }
+        int p = partition(a, l, r);
+        if (p - l < r - p) {
+            stack.push_back({p + 1, r});
+            stack.push_back({l, p - 1});
+        } else {
+            stack.push_back({l, p - 1});
+            stack.push_back({p + 1, r});
+        }
+    }
+}
+
+template <typename T, typename Partition>
+void quickSortWith(T* a, int n, Partition partition) {
+    quickSortWith(a, n, partition, QUICK_INSERTION_CUTOFF, [](T* x, int m) { smallSort(x, m); });
+}
+
+template <typename T>
+int lomutoPartition(T* a, int l, int r) {
+    int pivot = keyOf(a[r]);
+    int i = l;
+    for (int j = l; j < r; ++j) {
+        if (keyOf(a[j]) < pivot) std::swap(a[i++], a[j]);
+    }
+    std::swap(a[i], a[r]);
+    return i;
+}
+
+// BlockQuicksort partition (Edelkamp & Weiss). Comparison results of a block
+// from each end are written to offset buffers without branching on them
+// (the offset is stored unconditionally and the count advanced by the
+// comparison result), then misplaced pairs are swapped in bulk. The final
+// partial blocks go through a branchless Lomuto pass.
+template <typename T>
+int blockPartition(T* a, int l, int r, int block = BLOCKQS_BLOCK) {
+    const int pivot = keyOf(a[r]);
+    unsigned char offL[BLOCKQS_BLOCK], offR[BLOCKQS_BLOCK];
+    int lo = l, hi = r - 1;
+    int numL = 0, numR = 0, startL = 0, startR = 0;
+    while (hi - lo + 1 >= 2 * block) {
+        if (numL == 0) {
+            startL = 0;
+            for (int i = 0; i < block; ++i) {
+                offL[numL] = (unsigned char)i;
+                numL += !(keyOf(a[lo + i]) < pivot);
+            }
+        }
+        if (numR == 0) {
+            startR = 0;
+            for (int i = 0; i < block; ++i) {
+                offR[numR] = (unsigned char)i;
+                numR += keyOf(a[hi - i]) < pivot;
+            }
+        }
+        int num = std::min(numL, numR);
+        for (int k = 0; k < num; ++k) std::swap(a[lo + offL[startL + k]], a[hi - offR[startR + k]]);
+        numL -= num;
+        numR -= num;
+        startL += num;
+        startR += num;
+        if (numL == 0) lo += block;
+        if (numR == 0) hi -= block;
+    }
+    // Everything left of lo is < pivot and right of hi is >= pivot; an
+    // unfinished block just stays inside [lo, hi] and is repartitioned here.
+    int m = lo;
+    for (int j = lo; j <= hi; ++j) {
+        T x = a[j];
+        bool less = keyOf(x) < pivot;
+        a[j] = a[m];
+        a[m] = x;
+        m += less;
+    }
+    std::swap(a[m], a[r]);
+    return m;
+}
+
+template <typename T>
+void blockQuickSort(T* a, int n) {
+    quickSortWith(a, n, [](T* x, int l, int r) { return blockPartition(x, l, r); });
+}
+
+// Three-way quick sort (Bentley & McIlroy). With a strict `< pivot` test
+// every key equal to the pivot lands on one side, so inputs with few
+// distinct keys split badly and go quadratic. This partition scans from both
+// ends like Hoare's, parks keys equal to the pivot at the two ends as it
+// meets them and swaps them into the middle afterwards. The equal block is
+// final and only the strictly smaller and larger sides are sorted further.
+
+// Partitions [l, r] around the key of a[l]; returns the equal block.
+template <typename T>
+std::pair<int, int> threeWayPartition(T* a, int l, int r) {
+    const int pivot = keyOf(a[l]);
+    int i = l, j = r + 1, p = l, q = r + 1;
+    while (true) {
+        while (keyOf(a[++i]) < pivot) {
+            if (i == r) break;
+        }
+        while (pivot < keyOf(a[--j])) {
+            if (j == l) break;
+        }
+        if (i == j && keyOf(a[i]) == pivot) std::swap(a[++p], a[i]);
+        if (i >= j) break;
+        std::swap(a[i], a[j]);
+        if (keyOf(a[i]) == pivot) std::swap(a[++p], a[i]);
+        if (keyOf(a[j]) == pivot) std::swap(a[--q], a[j]);
+    }
+    i = j + 1;
+    for (int k = l; k <= p; ++k) std::swap(a[k], a[j--]);
+    for (int k = r; k >= q; --k) std::swap(a[k], a[i++]);
+    return {j + 1, i - 1};
+}
+
+// Partial quick sort (Martinez): ranges lying entirely at or past k are
+// dropped, so only a[0, k) ends sorted, holding the k smallest keys, in
+// O(n + k log k) expected time. k = n is the full sort.
+template <typename T>
+void partialQuickSort(T* a, int n, int k) {
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back({0, n - 1});
+    while (!stack.empty()) {
+        int l = stack.back().first, r = stack.back().second;
+        stack.pop_back();
+        if (l >= k) continue;
+        if (r - l + 1 <= QUICK_INSERTION_CUTOFF) {
+            if (r > l) smallSort(a + l, r - l + 1);
+            continue;
+        }
+        medianOfThreeToEnd(a, l, r);
+        std::swap(a[l], a[r]);
+        std::pair<int, int> equal = threeWayPartition(a, l, r);
+        if (equal.first - l < r - equal.second) {
+            stack.push_back({equal.second + 1, r});
+            stack.push_back({l, equal.first - 1});
+        } else {
+            stack.push_back({l, equal.first - 1});
+            stack.push_back({equal.second + 1, r});
+        }
+    }
+}
+
+template <typename T>
+void threeWayQuickSort(T* a, int n) {
+    partialQuickSort(a, n, n);
+}
+
+// Stable merge of sorted L and R into out; ties are taken from L.
+template <typename T>
+void mergeRuns(const T* L, int n1, const T* R, int n2, T* out) {
+    int i = 0, j = 0, k = 0;
+    while (i < n1 && j < n2) out[k++] = keyOf(R[j]) < keyOf(L[i]) ? R[j++] : L[i++];
+    while (i < n1) out[k++] = L[i++];
+    while (j < n2) out[k++] = R[j++];
+}
+
+// Plain keys have nothing to keep stable, so merges of ints go through the
+// vectorized kernel (defined with the other SIMD code below).
+void mergeRuns(const int* L, int n1, const int* R, int n2, int* out);
+
+// Merge passes over a[0..n) whose blocks of `run` elements are already sorted.
+template <typename T>
+void mergeSortedRuns(T* a, int n, int run) {
+    std::vector<T> buf(n);
+    T* src = a;
+    T* dst = buf.data();
+    for (int size = std::max(run, 1); size < n; size *= 2) {
+        for (int left = 0; left < n; left += 2 * size) {
+            int mid = std::min(left + size, n), right = std::min(left + 2 * size, n);
+            mergeRuns(src + left, mid - left, src + mid, right - mid, dst + left);
+        }
+        std::swap(src, dst);
+    }
+    if (src != a) std::copy(src, src + n, a);
+}
+
+// With run > 1, blocks of `run` elements are first sorted by smallSort.
+template <typename T>
+void bottomUpMergeSort(T* a, int n, int run = 1) {
+    if (run > 1) {
+        for (int left = 0; left < n; left += run) smallSort(a + left, std::min(run, n - left));
+    }
+    mergeSortedRuns(a, n, run);
+}
+
+// Heap sorts
+// Binary heap sort is the in-place O(n log n) reference. Smoothsort
+// (Dijkstra) keeps a forest of Leonardo heaps instead: tree sizes are
+// Leonardo numbers L(k) = L(k - 1) + L(k - 2) + 1, a tree of order k being a
+// root over subtrees of orders k - 1 and k - 2 laid out just before it. The
+// roots stay in ascending order left to right, so on sorted input nothing
+// moves and both the build and the dismantling are O(n). The forest shape
+// is a bit vector: bit i of p is a tree of order pshift + i, the rightmost
+// (bit 0) rooted at head.
+template <typename T>
+void siftDown(T* a, int i, int n) {
+    while (2 * i + 1 < n) {
+        int child = 2 * i + 1;
+        if (child + 1 < n && keyOf(a[child]) < keyOf(a[child + 1])) ++child;
+        if (!(keyOf(a[i]) < keyOf(a[child]))) return;
+        std::swap(a[i], a[child]);
+        i = child;
+    }
+}
+
+template <typename T>
+void heapSort(T* a, int n) {
+    for (int i = n / 2 - 1; i >= 0; --i) siftDown(a, i, n);
+    for (int end = n - 1; end > 0; --end) {
+        std::swap(a[0], a[end]);
+        siftDown(a, 0, end);
+    }
+}
+
+struct LeonardoNumbers {
+    int value[44];  // L(43) is the last that fits an int
+    constexpr LeonardoNumbers() : value() {
+        value[0] = value[1] = 1;
+        for (int k = 2; k < 44; ++k) value[k] = value[k - 1] + value[k - 2] + 1;
+    }
+};
+constexpr LeonardoNumbers LEONARDO;
+
+struct LeonardoForest {
+    int head = 0;
+    unsigned long long p = 1;
+    int pshift = 1;
+};
+
+inline int trailingZeros(unsigned long long x) {
+    int count = 0;
+    for (; !(x & 1); x >>= 1) ++count;
+    return count;
+}
+
+// Restores the heap order of the tree of `order` rooted at head.
+template <typename T>
+void leonardoSift(T* a, int head, int order) {
+    T value = a[head];
+    while (order > 1) {
+        int right = head - 1, left = head - 1 - LEONARDO.value[order - 2];
+        if (!(keyOf(value) < keyOf(a[left])) && !(keyOf(value) < keyOf(a[right]))) break;
+        if (!(keyOf(a[left]) < keyOf(a[right]))) {
+            a[head] = a[left];
+            head = left;
+            order -= 1;
+        } else {
+            a[head] = a[right];
+            head = right;
+            order -= 2;
+        }
+    }
+    a[head] = value;
+}
+
+// Moves the root at head left along the roots to its place among them, then
+// sifts it into that tree. `trusty` says head's own tree is already a heap.
+template <typename T>
+void leonardoTrinkle(T* a, int head, unsigned long long p, int order, bool trusty) {
+    T value = a[head];
+    while (p != 1) {
+        int stepson = head - LEONARDO.value[order];
+        if (!(keyOf(value) < keyOf(a[stepson]))) break;
+        if (!trusty && order > 1) {
+            int right = head - 1, left = head - 1 - LEONARDO.value[order - 2];
+            if (!(keyOf(a[right]) < keyOf(a[stepson])) || !(keyOf(a[left]) < keyOf(a[stepson]))) break;
+        }
+        a[head] = a[stepson];
+        head = stepson;
+        int trail = trailingZeros(p & ~1ULL);
+        p >>= trail;
+        order += trail;
+        trusty = false;
+    }
+    if (!trusty) {
+        a[head] = value;
+        leonardoSift(a, head, order);
+    }
+}
+
+// Adds a[head + 1] to the forest over a[0..head]. Trees that can no longer
+// merge with anything to their right are fully ordered (trinkled) now.
+template <typename T>
+void smoothsortGrow(T* a, int n, LeonardoForest& f) {
+    if ((f.p & 3) == 3) {
+        leonardoSift(a, f.head, f.pshift);
+        f.p >>= 2;
+        f.pshift += 2;
+    } else {
+        if (LEONARDO.value[f.pshift - 1] >= n - 1 - f.head) {
+            leonardoTrinkle(a, f.head, f.p, f.pshift, false);
+        } else {
+            leonardoSift(a, f.head, f.pshift);
+        }
+        if (f.pshift == 1) {
+            f.p <<= 1;
+            --f.pshift;
+        } else {
+            f.p <<= f.pshift - 1;
+            f.pshift = 1;
+        }
+    }
+    f.p |= 1;
+    ++f.head;
+}
+
+inline bool smoothsortDone(const LeonardoForest& f) { return f.pshift == 1 && f.p == 1; }
+
+// The trees of the forest as (first index, order), left to right.
+inline std::vector<std::pair<int, int>> leonardoTrees(const LeonardoForest& f) {
+    std::vector<std::pair<int, int>> trees;
+    int start = 0;
+    for (int bit = 63; bit >= 0; --bit) {
+        if (!((f.p >> bit) & 1)) continue;
+        int order = f.pshift + bit;
+        trees.push_back({start, order});
+        start += LEONARDO.value[order];
+    }
+    return trees;
+}
+
+// Takes the maximum a[head] out of the forest: a tree of order 0 or 1 just
+// disappears, a larger one splits into its two subtrees, whose roots are
+// trinkled back into place.
+template <typename T>
+void smoothsortShrink(T* a, LeonardoForest& f) {
+    if (f.pshift <= 1) {
+        int trail = trailingZeros(f.p & ~1ULL);
+        f.p >>= trail;
+        f.pshift += trail;
+    } else {
+        f.p <<= 2;
+        f.p ^= 7;
+        f.pshift -= 2;
+        leonardoTrinkle(a, f.head - LEONARDO.value[f.pshift] - 1, f.p >> 1, f.pshift + 1, true);
+        leonardoTrinkle(a, f.head - 1, f.p, f.pshift, true);
+    }
+    --f.head;
+}
+
+template <typename T>
+void smoothsort(T* a, int n) {
+    if (n < 2) return;
+    LeonardoForest f;
+    while (f.head < n - 1) smoothsortGrow(a, n, f);
+    leonardoTrinkle(a, f.head, f.p, f.pshift, false);
+    while (!smoothsortDone(f)) smoothsortShrink(a, f);
+}
+
+// Timsort stand-in for benchmarks: natural runs (strictly descending ones
+// reversed) merged pairwise, without Timsort's minimum run length, merge
+// stack or galloping.
+template <typename T>
+void naturalMergeSort(T* a, int n) {
+    std::vector<int> bounds(1, 0);
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        if (j < n && keyOf(a[j]) < keyOf(a[i])) {
+            while (j < n && keyOf(a[j]) < keyOf(a[j - 1])) ++j;
+            std::reverse(a + i, a + j);
+        } else {
+            while (j < n && !(keyOf(a[j]) < keyOf(a[j - 1]))) ++j;
+        }
+        bounds.push_back(j);
+        i = j;
+    }
+    std::vector<T> buffer(n);
+    while (bounds.size() > 2) {
+        std::vector<int> next(1, 0);
+        size_t r = 0;
+        for (; r + 2 < bounds.size(); r += 2) {
+            int lo = bounds[r], mid = bounds[r + 1], hi = bounds[r + 2];
+            mergeRuns(a + lo, mid - lo, a + mid, hi - mid, buffer.data() + lo);
+            std::copy(buffer.data() + lo, buffer.data() + hi, a + lo);
+            next.push_back(hi);
+        }
+        if (r + 1 < bounds.size()) next.push_back(bounds.back());
+        bounds.swap(next);
+    }
+}
+
+// Selection
+// These stop once the target is established and leave the rest unsorted;
+// the benchmarks and the title measure the work saved against a full sort.
+
+// Gathers the k smallest keys of a[0, n) into a max-heap on a[0, k): each
+// later key smaller than the root replaces it. O(n log k).
+template <typename T>
+void heapKeepSmallest(T* a, int n, int k) {
+    for (int i = k / 2 - 1; i >= 0; --i) siftDown(a, i, k);
+    for (int i = k; i < n; ++i) {
+        if (keyOf(a[i]) < keyOf(a[0])) {
+            std::swap(a[i], a[0]);
+            siftDown(a, 0, k);
+        }
+    }
+}
+
+// Heap top-k (what std::partial_sort does): a[0, k) ends as the k smallest
+// keys in order.
+template <typename T>
+void heapTopK(T* a, int n, int k) {
+    if (k <= 0) return;
+    heapKeepSmallest(a, n, k);
+    for (int end = k - 1; end > 0; --end) {
+        std::swap(a[0], a[end]);
+        siftDown(a, 0, end);
+    }
+}
+
+// Puts the key of sorted rank k at a[k] with no larger key before it and no
+// smaller one after it.
+template <typename T>
+void heapSelect(T* a, int n, int k) {
+    heapKeepSmallest(a, n, k + 1);
+    std::swap(a[0], a[k]);
+}
+
+// Introselect: quickselect on three-way partitions, keeping only the side
+// that holds index k. After 2 log2(n) partitions without reaching it (bad
+// pivots) the remaining range is finished by heapSelect, which bounds the
+// worst case at O(n log n); the expected time is O(n).
+template <typename T>
+void introSelect(T* a, int n, int k) {
+    int l = 0, r = n - 1, budget = 0;
+    for (int m = n; m > 1; m /= 2) budget += 2;
+    while (r - l + 1 > QUICK_INSERTION_CUTOFF) {
+        if (budget-- == 0) {
+            heapSelect(a + l, r - l + 1, k - l);
+            return;
+        }
+        medianOfThreeToEnd(a, l, r);
+        std::swap(a[l], a[r]);
+        std::pair<int, int> equal = threeWayPartition(a, l, r);
+        if (k < equal.first) {
+            r = equal.first - 1;
+        } else if (k > equal.second) {
+            l = equal.second + 1;
+        } else {
+            return;
+        }
+    }
+    if (r > l) smallSort(a + l, r - l + 1);
+}
+
+// Block merge sort (in-place, stable)
+// A WikiSort/GrailSort-style merge sort that needs no allocation. Up to 2s
+// distinct keys (s = the power of two with s * s >= n) are collected at the
+// front: the first s tag the blocks of a merge and the next s are the
+// internal merge buffer, which moves through the array by swaps so its
+// contents are only permuted. Runs of up to s elements merge through the
+// buffer directly; longer pairs are cut into s-element blocks that are
+// selection-sorted by first key (tags break ties, keeping A before B) and
+// then merged block by block through the buffer. Inputs with too few
+// distinct keys fall back to rotation merges above the buffer size. The
+// keys are sorted last and merged back in by rotations; each key is the
+// first occurrence of its value, which keeps the whole sort stable.
+const int BLOCK_MERGE_FIRST_RUN = 16;
+
+// Stable merge of a[lo, mid) and a[mid, hi) with rotations and no buffer
+// (recursion depth is logarithmic).
+template <typename T>
+void rotationMerge(T* a, int lo, int mid, int hi) {
+    if (lo == mid || mid == hi || !(keyOf(a[mid]) < keyOf(a[mid - 1]))) return;
+    int cut1, cut2;
+    if (mid - lo >= hi - mid) {
+        cut1 = lo + (mid - lo) / 2;
+        cut2 = lowerBoundKey(a, mid, hi, a[cut1]);
+    } else {
+        cut2 = mid + (hi - mid) / 2;
+        cut1 = upperBoundKey(a, lo, mid, a[cut2]);
+    }
+    std::rotate(a + cut1, a + mid, a + cut2);
+    int newMid = cut1 + (cut2 - mid);
+    rotationMerge(a, lo, cut1, newMid);
+    rotationMerge(a, newMid, cut2, hi);
+}
+
+// Gathers the first occurrences of up to `wanted` distinct keys, sorted, at
+// a[0, count) and returns count. The key block rolls forward by rotations
+// and every other element keeps its relative order.
+template <typename T>
+int collectKeys(T* a, int n, int wanted) {
+    int start = 0, count = 1;
+    for (int i = 1; i < n && count < wanted; ++i) {
+        int pos = lowerBoundKey(a, start, start + count, a[i]);
+        if (pos < start + count && !(keyOf(a[i]) < keyOf(a[pos]))) continue;
+        std::rotate(a + start, a + start + count, a + i);
+        pos += i - count - start;
+        start = i - count;
+        std::rotate(a + pos, a + i, a + i + 1);
+        ++count;
+    }
+    std::rotate(a, a + start, a + start + count);
+    return count;
+}
+
+// Moves a[from, to) by `by` positions (negative is left) through the buffer
+// elements next to it, swapping them to the other side.
+template <typename T>
+void shiftThroughBuffer(T* a, int from, int to, int by) {
+    if (by < 0) {
+        for (int k = from; k < to; ++k) std::swap(a[k + by], a[k]);
+    } else {
+        for (int k = to - 1; k >= from; --k) std::swap(a[k], a[k + by]);
+    }
+}
+
+// Merges a[l, m) with a[m, e), e - m <= s, into the s buffer elements in
+// front of l until one side runs out; ties go to the left side when
+// leftFirst. Returns the start of the unmerged rest, which ends at e and has
+// the buffer directly in front of it again; leftRemains tells its side.
+template <typename T>
+int bufferedMerge(T* a, int l, int m, int e, int s, bool leftFirst, bool& leftRemains) {
+    int out = l - s, i = l, j = m;
+    while (i < m && j < e) {
+        bool takeRight = leftFirst ? keyOf(a[j]) < keyOf(a[i]) : !(keyOf(a[i]) < keyOf(a[j]));
+        std::swap(a[out++], a[takeRight ? j++ : i++]);
+    }
+    leftRemains = i < m;
+    if (!leftRemains) return j;
+    shiftThroughBuffer(a, i, m, e - m);
+    return i + (e - m);
+}
+
+// Where the keys, tags and buffer ended up, and the run size to start from.
+struct BlockMergeLayout {
+    int keys;      // distinct keys at a[0, keys)
+    int buffer;    // merge buffer a[data - buffer, data), also the block size
+    bool tagged;   // a[0, buffer) tag blocks, so long runs block-merge
+    int data;      // start of the elements being merged
+    int firstRun;
+};
+
+template <typename T>
+BlockMergeLayout blockMergeSetup(T* a, int n) {
+    int s = 1;
+    while (s * s < n) s *= 2;
+    BlockMergeLayout layout;
+    layout.keys = n > 0 ? collectKeys(a, n, 2 * s) : 0;
+    layout.tagged = layout.keys == 2 * s;
+    layout.buffer = layout.tagged ? s : layout.keys;
+    layout.data = layout.keys;
+    layout.firstRun = layout.tagged ? std::min(BLOCK_MERGE_FIRST_RUN, s) : BLOCK_MERGE_FIRST_RUN;
+    return layout;
+}
+
+// Block merge of A = a[lo, mid) (a whole number of blocks) and B = a[mid, hi)
+// with the buffer in front of lo. Returns where the buffer ended up (hi - s).
+template <typename T>
+int blockMergePair(T* a, T* tags, int lo, int mid, int hi, int s) {
+    int blocksA = (mid - lo) / s, blocks = blocksA + (hi - mid) / s;
+    int blocksEnd = lo + blocks * s;
+    // Tags below the first B block's tag mark A blocks.
+    T midTag = tags[std::min(blocksA, blocks - 1)];
+    auto fromA = [&](int block) { return blocksA == blocks || keyOf(tags[block]) < keyOf(midTag); };
+
+    for (int i = 0; i < blocks; ++i) {
+        int min = i;
+        for (int j = i + 1; j < blocks; ++j) {
+            T* x = a + lo + j * s;
+            T* y = a + lo + min * s;
+            if (keyOf(*x) < keyOf(*y) || (!(keyOf(*y) < keyOf(*x)) && keyOf(tags[j]) < keyOf(tags[min]))) min = j;
+        }
+        if (min != i) {
+            std::swap_ranges(a + lo + i * s, a + lo + i * s + s, a + lo + min * s);
+            std::swap(tags[i], tags[min]);
+        }
+    }
+
+    // The run kept unmerged is the rest of the last block from one side; a
+    // block from the same side can only follow it, so it is final then.
+    int rest = lo;
+    bool restFromA = fromA(0);
+    for (int i = 1; i < blocks; ++i) {
+        int block = lo + i * s;
+        bool blockFromA = fromA(i);
+        if (blockFromA == restFromA) {
+            shiftThroughBuffer(a, rest, block, -s);
+            rest = block;
+        } else {
+            bool leftRemains;
+            rest = bufferedMerge(a, rest, block, block + s, s, restFromA, leftRemains);
+            if (!leftRemains) restFromA = blockFromA;
+        }
+    }
+    shiftThroughBuffer(a, rest, blocksEnd, -s);
+    insertionSortRange(tags, blocks);
+    if (blocksEnd == hi) return hi - s;
+
+    // Partial last block of B: roll the buffer back in front of the merged
+    // blocks and merge it in like a short run.
+    std::rotate(a + lo - s, a + blocksEnd - s, a + blocksEnd);
+    bool leftRemains;
+    rest = bufferedMerge(a, lo, blocksEnd, hi, s, true, leftRemains);
+    shiftThroughBuffer(a, rest, hi, -s);
+    return hi - s;
+}
+
+// Merges the pair of runs starting at lo and returns the buffer's position.
+template <typename T>
+int blockMergeStep(T* a, int n, const BlockMergeLayout& layout, int lo, int run) {
+    int mid = lo + run, hi = std::min(n, lo + 2 * run), s = layout.buffer;
+    if (run > s) {
+        if (!layout.tagged) {
+            rotationMerge(a, lo, mid, hi);
+            return layout.data - s;
+        }
+        return blockMergePair(a, a, lo, mid, hi, s);
+    }
+    bool leftRemains;
+    int rest = bufferedMerge(a, lo, mid, hi, s, true, leftRemains);
+    shiftThroughBuffer(a, rest, hi, -s);
+    return hi - s;
+}
+
+// Rolls the buffer back to the front of the data after a level.
+template <typename T>
+void blockMergeRewind(T* a, const BlockMergeLayout& layout, int bufferAt) {
+    std::rotate(a + layout.data - layout.buffer, a + bufferAt, a + bufferAt + layout.buffer);
+}
+
+template <typename T>
+void blockMergeFinish(T* a, int n, const BlockMergeLayout& layout) {
+    insertionSortRange(a, layout.keys);
+    rotationMerge(a, 0, layout.keys, n);
+}
+
+template <typename T>
+void blockMergeSort(T* a, int n) {
+    BlockMergeLayout layout = blockMergeSetup(a, n);
+    for (int lo = layout.data; lo < n; lo += layout.firstRun) insertionSortRange(a + lo, std::min(layout.firstRun, n - lo));
+    for (int run = layout.firstRun; run < n - layout.data; run *= 2) {
+        int bufferAt = layout.data - layout.buffer;
+        for (int lo = layout.data; lo + run < n; lo += 2 * run) bufferAt = blockMergeStep(a, n, layout, lo, run);
+        blockMergeRewind(a, layout, bufferAt);
+    }
+    blockMergeFinish(a, n, layout);
+}
+
+// k-way merge
+// Sources expose empty(), head() and pop(); the merges emit their merged
+// contents in order. Ties go to the lower source index, so merging
+// consecutive runs is stable. The loser tree is the engine; the binary heap
+// and the linear scan are the reference points in benchmarks.
+template <typename T>
+struct ArrayRun {
+    const T* next;
+    const T* end;
+    bool empty() const { return next == end; }
+    const T& head() const { return *next; }
+    T pop() { return *next++; }
+};
+
+template <typename Source, typename Emit>
+void heapMerge(std::vector<Source>& sources, Emit emit) {
+    auto after = [&](int x, int y) {
+        return y < x ? !(keyOf(sources[x].head()) < keyOf(sources[y].head())) : keyOf(sources[y].head()) < keyOf(sources[x].head());
+    };
+    std::vector<int> heap;
+    for (int i = 0; i < (int)sources.size(); ++i) {
+        if (!sources[i].empty()) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        int s = heap.back();
+        emit(sources[s].pop());
+        if (sources[s].empty()) {
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+    }
+}
+
+// Scans every head for each output element: O(k) comparisons per element.
+template <typename Source, typename Emit>
+void linearScanMerge(std::vector<Source>& sources, Emit emit) {
+    while (true) {
+        int best = -1;
+        for (int i = 0; i < (int)sources.size(); ++i) {
+            if (!sources[i].empty() && (best < 0 || keyOf(sources[i].head()) < keyOf(sources[best].head()))) best = i;
+        }
+        if (best < 0) return;
+        emit(sources[best].pop());
+    }
+}
+
+// Tournament tree of losers. node[1..k) is a flat, heap-shaped array holding
+// the loser of the match played at each internal node, node[0] the overall
+// winner; source i is the virtual leaf k + i. After the winner is popped,
+// only the matches on its leaf-to-root path are replayed against the stored
+// losers, about log2(k) comparisons, and no winners are stored on the way.
+// Exhausted sources lose every match.
+template <typename Source>
+class LoserTree {
+public:
+    explicit LoserTree(std::vector<Source>& sources) : src(sources), k((int)sources.size()), node(std::max(1, k), 0) {
+        std::vector<int> winners(2 * k);
+        for (int i = 0; i < k; ++i) winners[k + i] = i;
+        for (int j = k - 1; j >= 1; --j) {
+            int l = winners[2 * j], r = winners[2 * j + 1];
+            bool leftWins = beats(l, r);
+            winners[j] = leftWins ? l : r;
+            node[j] = leftWins ? r : l;
+        }
+        if (k > 0) node[0] = winners[1];
+    }
+    bool empty() const { return k == 0 || src[node[0]].empty(); }
+    int size() const { return k; }
+    // Source that holds node j: the winner for j == 0, else a loser.
+    int at(int j) const { return node[j]; }
+    // First node replayed after source s wins; parents follow by halving.
+    int leafParent(int s) const { return (s + k) / 2; }
+    auto pop() {
+        int w = node[0];
+        auto x = src[w].pop();
+        for (int j = leafParent(w); j >= 1; j /= 2) {
+            if (beats(node[j], w)) std::swap(node[j], w);
+        }
+        node[0] = w;
+        return x;
+    }
+
+private:
+    bool beats(int a, int b) const {
+        if (src[a].empty() || src[b].empty()) return src[b].empty() && (!src[a].empty() || a < b);
+        return a < b ? !(keyOf(src[b].head()) < keyOf(src[a].head())) : keyOf(src[a].head()) < keyOf(src[b].head());
+    }
+
+    std::vector<Source>& src;
+    int k;
+    std::vector<int> node;
+};
+
+template <typename Source, typename Emit>
+void loserTreeMerge(std::vector<Source>& sources, Emit emit) {
+    LoserTree<Source> tree(sources);
+    while (!tree.empty()) emit(tree.pop());
+}
+
+// In-memory model of the external sort: chunks of `chunk` elements are
+// sorted separately (the "runs"), then all of them are k-way merged at once.
+// On screen the memory budget is EXTERNAL_VIS_CHUNK bars.
+const int EXTERNAL_VIS_CHUNK = 16;
+
+template <typename T>
+void chunkedMergeSort(T* a, int n, int chunk) {
+    std::vector<ArrayRun<T>> runs;
+    for (int lo = 0; lo < n; lo += chunk) {
+        int len = std::min(chunk, n - lo);
+        bottomUpMergeSort(a + lo, len);
+        runs.push_back({a + lo, a + lo + len});
+    }
+    std::vector<T> out;
+    out.reserve(n);
+    loserTreeMerge(runs, [&](const T& x) { out.push_back(x); });
+    std::copy(out.begin(), out.end(), a);
+}
+
+// Funnelsort
+// Lazy funnelsort (Brodal and Fagerberg, after Frigo et al.) is cache-
+// oblivious: it makes the optimal number of cache misses at every level of
+// the memory hierarchy without knowing any cache size. The input is split
+// into about n^(1/3) segments, each sorted recursively, and the sorted
+// segments are merged by a k-funnel: a complete binary merge tree whose
+// internal nodes each own an output buffer. A buffer is refilled only when
+// its parent finds it empty, by merging its two children (refilling those
+// first when they run dry) until it is full or both are exhausted. A node
+// with 2^h leaves below it gets a buffer of (2^h)^3 elements, its size in
+// the van Emde Boas split of the funnel, and the buffers are laid out in
+// that order (top half of the tree, then every bottom subtree, recursively)
+// in one arena, so any subtree small enough for some cache is contiguous.
+// The caller owns the arena, so the funnels of a whole sort share one. The
+// root's buffer is only allocated for pop(); drain() merges the root's
+// children straight into the output. Ties go to the left child, which keeps
+// the sort stable.
+const int FUNNEL_BASE = 32;
+const int FUNNEL_VIS_BASE = 8;
+
+template <typename T>
+class KFunnel {
+public:
+    KFunnel(const std::vector<ArrayRun<T>>& runs, std::vector<T>& arena) : k(2), arena(arena) {
+        while (k < (int)runs.size()) k *= 2;
+        stream.assign(2 * k, {nullptr, nullptr});
+        std::copy(runs.begin(), runs.end(), stream.begin() + k);
+        std::vector<long long> total(2 * k, 0);
+        for (int i = 0; i < k; ++i) total[k + i] = stream[k + i].end - stream[k + i].next;
+        for (int j = k - 1; j >= 1; --j) total[j] = total[2 * j] + total[2 * j + 1];
+        count = total[1];
+        cap.assign(k, 0);
+        for (int j = 1, below = k; j < k; ++j) {
+            if ((j & (j - 1)) == 0 && j > 1) below /= 2;
+            cap[j] = (int)std::min(total[j], (long long)below * below * below);
+        }
+        offset.assign(k, 0);
+        exhausted.assign(k, false);
+        refillCount.assign(k, 0);
+        int levels = 0;
+        while ((1 << levels) < k) ++levels;
+        size_t at = 0;
+        layout(1, levels, at);
+        if (arena.size() < at) arena.resize(at);
+    }
+    bool empty() { return !ready(1); }
+    T pop() {
+        ready(1);
+        return stream[1].pop();
+    }
+    // Writes all elements to out in order; use instead of pop().
+    void drain(T* out) {
+        merge(1, out, out + count);
+        exhausted[1] = true;
+    }
+    // Internal nodes are 1 .. size() - 1, children of j at 2j and 2j + 1.
+    int size() const { return k; }
+    int capacity(int j) const { return cap[j]; }
+    int buffered(int j) const { return (int)(stream[j].end - stream[j].next); }
+    const T* buffer(int j) const { return stream[j].next; }
+    int refills(int j) const { return refillCount[j]; }
+    const ArrayRun<T>& leaf(int i) const { return stream[k + i]; }
+
+private:
+    // Buffers of the subtree rooted at j with `levels` levels of internal
+    // nodes, in van Emde Boas order. The root's is kept out of the arena.
+    void layout(int j, int levels, size_t& at) {
+        if (levels == 1) {
+            offset[j] = at;
+            if (j > 1) at += cap[j];
+            return;
+        }
+        int top = levels / 2;
+        layout(j, top, at);
+        for (int d = j << top; d < (j + 1) << top; ++d) layout(d, levels - top, at);
+    }
+    // True if node or leaf c has an element to give, refilling it if needed.
+    bool ready(int c) {
+        if (!stream[c].empty()) return true;
+        if (c >= k || exhausted[c]) return false;
+        fill(c);
+        return !stream[c].empty();
+    }
+    // Refills j's buffer from its children.
+    void fill(int j) {
+        ++refillCount[j];
+        if (j == 1) root.resize(cap[1]);
+        T* begin = j == 1 ? root.data() : arena.data() + offset[j];
+        T* out = merge(j, begin, begin + cap[j]);
+        if (out != begin + cap[j] || cap[j] == 0) exhausted[j] = true;
+        stream[j] = {begin, out};
+    }
+    // Merges both children of j into [out, stop), in stretches while
+    // neither needs a refill, and returns the end of what was written.
+    T* merge(int j, T* out, T* stop) {
+        ArrayRun<T>& l = stream[2 * j];
+        ArrayRun<T>& r = stream[2 * j + 1];
+        while (out != stop) {
+            bool hasL = ready(2 * j), hasR = ready(2 * j + 1);
+            if (!hasL && !hasR) break;
+            if (hasL && hasR) {
+                while (out != stop && !l.empty() && !r.empty()) *out++ = keyOf(r.head()) < keyOf(l.head()) ? r.pop() : l.pop();
+            } else {
+                ArrayRun<T>& rest = hasL ? l : r;
+                while (out != stop && !rest.empty()) *out++ = rest.pop();
+            }
+        }
+        return out;
+    }
+
+    int k;
+    long long count;
+    // Leaves k .. 2k - 1 are the input runs; internal node j reads from
+    // its buffer's unread part.
+    std::vector<ArrayRun<T>> stream;
+    std::vector<int> cap, refillCount;
+    std::vector<size_t> offset;
+    std::vector<bool> exhausted;
+    std::vector<T>& arena;
+    std::vector<T> root;
+};
+
+// Segment length for splitting n elements into about n^(1/3) segments.
+inline int funnelSegment(int n) {
+    int k = (int)std::ceil(std::cbrt((double)n));
+    return (n + k - 1) / k;
+}
+
+template <typename T>
+void funnelSortInto(T* a, int n, T* scratch, std::vector<T>& arena, int base) {
+    if (n <= base) {
+        smallSort(a, n);
+        return;
+    }
+    int segment = funnelSegment(n);
+    std::vector<ArrayRun<T>> runs;
+    for (int lo = 0; lo < n; lo += segment) {
+        int len = std::min(segment, n - lo);
+        funnelSortInto(a + lo, len, scratch + lo, arena, base);
+        runs.push_back({a + lo, a + lo + len});
+    }
+    KFunnel<T>(runs, arena).drain(scratch);
+    std::copy(scratch, scratch + n, a);
+}
+
+template <typename T>
+void funnelSort(T* a, int n, int base = FUNNEL_BASE) {
+    std::vector<T> scratch(n), arena;
+    funnelSortInto(a, n, scratch.data(), arena, base);
+}
+
+// Patience sort
+// Elements are dealt left to right, each onto the leftmost pile whose top is
+// greater (a binary search: the tops stay in ascending order) or onto a new
+// pile at the right. Every pile is then strictly descending from bottom to
+// top, so read top-down the piles are ascending runs; patienceRuns reverses
+// them for the loser tree. Equal keys land on piles
+// left to right in input order, so the merge keeps the sort stable. The pile
+// count k is the length of the longest non-decreasing subsequence (LIS), and
+// the merge costs O(n log k): one pile for reversed input, one per element
+// for sorted input.
+
+// Deals x onto its pile; tops[p] is the top of pile p. Returns the pile.
+template <typename T>
+int patienceDeal(std::vector<T>& tops, const T& x) {
+    int p = upperBoundKey(tops.data(), 0, (int)tops.size(), x);
+    if (p == (int)tops.size()) {
+        tops.push_back(x);
+    } else {
+        tops[p] = x;
+    }
+    return p;
+}
+
+// Reverses each pile into an ascending run and returns them as merge sources.
+template <typename T>
+std::vector<ArrayRun<T>> patienceRuns(std::vector<std::vector<T>>& piles) {
+    std::vector<ArrayRun<T>> runs;
+    for (auto& pile : piles) {
+        std::reverse(pile.begin(), pile.end());
+        runs.push_back({pile.data(), pile.data() + pile.size()});
+    }
+    return runs;
+}
+
+template <typename T>
+void patienceSort(T* a, int n) {
+    std::vector<T> tops;
+    std::vector<std::vector<T>> piles;
+    for (int i = 0; i < n; ++i) {
+        int p = patienceDeal(tops, a[i]);
+        if (p == (int)piles.size()) piles.emplace_back();
+        piles[p].push_back(a[i]);
+    }
+    std::vector<ArrayRun<T>> runs = patienceRuns(piles);
+    T* out = a;
+    loserTreeMerge(runs, [&](const T& x) { *out++ = x; });
+}
+
+// LIS length from a deal that keeps only the tops. n minus it (Rem) is the
+// fewest elements that have to move to sort a, a presortedness measure that
+// predicts how much adaptive sorts can skip.
+template <typename T>
+int longestSortedSubsequence(const T* a, int n) {
+    std::vector<T> tops;
+    for (int i = 0; i < n; ++i) patienceDeal(tops, a[i]);
+    return (int)tops.size();
+}
+
+// Bitonic sorting network
+// Stages are indexed by block size k (2, 4, ..., N) and partner distance j
+// (k/2 down to 1). The first stage of each block compares i with its mirror
+// i ^ (k - 1), so every compare-exchange puts the minimum at the lower index
+// and a non power-of-two n behaves as if padded with +inf: pairs whose
+// partner lies past the end are simply skipped.
+inline int bitonicPartner(int i, int k, int j) { return j == k / 2 ? i ^ (k - 1) : i ^ j; }
+
+inline int nextPowerOfTwo(int n) {
+    int p = 1;
+    while (p < n) p *= 2;
+    return p;
+}
+
+// One stage restricted to lower indices in [from, to).
+template <typename T>
+void bitonicStage(T* a, int n, int k, int j, int from, int to) {
+    for (int i = from; i < to; ++i) {
+        int p = bitonicPartner(i, k, j);
+        if (p > i && p < n) compareExchange(a[i], a[p]);
+    }
+}
+
+template <typename T>
+void bitonicSort(T* a, int n) {
+    int N = nextPowerOfTwo(n);
+    for (int k = 2; k <= N; k *= 2) {
+        for (int j = k / 2; j > 0; j /= 2) {
+            for (int base = 0; base < n; base += 2 * j) {
+                for (int i = base; i < base + j && i < n; ++i) {
+                    int p = bitonicPartner(i, k, j);
+                    if (p < n) compareExchange(a[i], a[p]);
+                }
+            }
+        }
+    }
+}
+
+enum SimdLevel { SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512, SIMD_LEVEL_COUNT };
+const char* SIMD_NAMES[] = {"scalar", "AVX2", "AVX-512"};
+
+inline SimdLevel detectSimdLevel() {
+#ifdef SORTVIS_X86
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+#ifdef SORTVIS_X86
+// All stages of block size k with partner distance below 8 on one register;
+// those pairs never leave an aligned group of 8.
+__attribute__((target("avx2"))) inline __m256i bitonicSmallStagesAvx2(__m256i v, int k) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i p;
+    if (k >= 16 || k == 8) {
+        p = k == 8 ? _mm256_permutevar8x32_epi32(v, reverse) : _mm256_permute2x128_si256(v, v, 0x01);
+        v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xF0);
+    }
+    if (k >= 4) {
+        p = k == 4 ? _mm256_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)) : _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xCC);
+    }
+    p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), 0xAA);
+}
+
+// Stages with j >= 8 run as 8-wide min/max over contiguous runs (the mirror
+// stage reverses the upper run in-register); the j < 8 tail of each block
+// size is fused per register. Partial groups at the end fall back to scalar.
+__attribute__((target("avx2"))) void bitonicSortAvx2(int* a, int n) {
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    int N = nextPowerOfTwo(n);
+    for (int k = 2; k <= N; k *= 2) {
+        for (int j = k / 2; j >= 8; j /= 2) {
+            bool mirror = j == k / 2;
+            for (int base = 0; base < n; base += 2 * j) {
+                for (int i = base; i < base + j && i < n; i += 8) {
+                    int p = bitonicPartner(i, k, j);
+                    int lo = mirror ? p - 7 : p;
+                    if (mirror ? p >= n : p + 8 > n) {
+                        bitonicStage(a, n, k, j, i, std::min(i + 8, n));
+                        continue;
+                    }
+                    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+                    __m256i y = _mm256_loadu_si256((const __m256i*)(a + lo));
+                    if (mirror) y = _mm256_permutevar8x32_epi32(y, reverse);
+                    __m256i mn = _mm256_min_epi32(x, y), mx = _mm256_max_epi32(x, y);
+                    if (mirror) mx = _mm256_permutevar8x32_epi32(mx, reverse);
+                    _mm256_storeu_si256((__m256i*)(a + i), mn);
+                    _mm256_storeu_si256((__m256i*)(a + lo), mx);
+                }
+            }
+        }
+        int full = n & ~7;
+        for (int i = 0; i < full; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+            _mm256_storeu_si256((__m256i*)(a + i), bitonicSmallStagesAvx2(v, k));
+        }
+        for (int j = std::min(k / 2, 4); j > 0; j /= 2) bitonicStage(a, n, k, j, full, n);
+    }
+}
+#endif
+
+// Parallel helpers
+
+// Runs fn(t) for t in [0, threads) on their own threads, the caller taking t = 0.
+template <typename F>
+void runOnThreads(int threads, F fn) {
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t) workers.emplace_back(fn, t);
+    fn(0);
+    for (auto& w : workers) w.join();
+}
+
+// Start of worker t's share when `count` items are split over `threads`.
+inline int chunkBegin(int count, int t, int threads) { return (int)((long long)count * t / threads); }
+
+inline int hardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Reusable barrier for short phases; spins with yield rather than sleeping so
+// the per-phase cost stays small.
+class SpinBarrier {
+public:
+    explicit SpinBarrier(int count) : count(count), waiting(0), generation(0) {}
+    void wait() {
+        int gen = generation.load(std::memory_order_acquire);
+        if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+            waiting.store(0, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+        } else {
+            while (generation.load(std::memory_order_acquire) == gen) std::this_thread::yield();
+        }
+    }
+
+private:
+    const int count;
+    std::atomic<int> waiting;
+    std::atomic<int> generation;
+};
+
+// Odd-even transposition sort: phase p compares the disjoint pairs
+// (i, i + 1) with i = p % 2, p % 2 + 2, ...; each worker takes a contiguous
+// share of the pairs and all meet at a barrier before the next phase.
+// n phases always suffice.
+template <typename T>
+void oddEvenTranspositionSort(T* a, int n, int threads) {
+    SpinBarrier barrier(threads);
+    runOnThreads(threads, [&](int t) {
+        for (int phase = 0; phase < n; ++phase) {
+            int first = phase & 1;
+            int pairs = (n - first) / 2;
+            for (int q = chunkBegin(pairs, t, threads), end = chunkBegin(pairs, t + 1, threads); q < end; ++q) {
+                compareExchange(a[first + 2 * q], a[first + 2 * q + 1]);
+            }
+            barrier.wait();
+        }
+    });
+}
+
+struct TaskGroup {
+    std::atomic<int> pending{0};
+};
+
+// Fork-join pool: every worker owns a deque, pushing and popping its own
+// tasks at the back and stealing from the front of the others' when it runs
+// dry. The thread that constructs the pool is worker 0 and helps run tasks
+// while it waits.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads);
+    ~WorkStealingPool();
+    int size() const { return threadCount; }
+    void spawn(TaskGroup& group, std::function<void()> fn);
+    void wait(TaskGroup& group);
+    static int currentWorker() { return workerIndex(); }
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+    struct Deque {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    int threadCount;
+    std::unique_ptr<Deque[]> deques;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping;
+
+    static int& workerIndex() {
+        static thread_local int index = 0;
+        return index;
+    }
+    bool runOne();
+    void workerLoop(int index);
+};
+
+WorkStealingPool::WorkStealingPool(int threads) : threadCount(std::max(1, threads)), deques(new Deque[std::max(1, threads)]), stopping(false) {
+    workerIndex() = 0;
+    for (int t = 1; t < threadCount; ++t) workers.emplace_back(&WorkStealingPool::workerLoop, this, t);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stopping = true;
+    for (auto& w : workers) w.join();
+}
+
+void WorkStealingPool::spawn(TaskGroup& group, std::function<void()> fn) {
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    Deque& own = deques[workerIndex()];
+    std::lock_guard<std::mutex> guard(own.lock);
+    own.tasks.push_back({std::move(fn), &group});
+}
+
+void WorkStealingPool::wait(TaskGroup& group) {
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        if (!runOne()) std::this_thread::yield();
+    }
+}
+
+bool WorkStealingPool::runOne() {
+    int self = workerIndex();
+    Task task;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> guard(deques[self].lock);
+        if (!deques[self].tasks.empty()) {
+            task = std::move(deques[self].tasks.back());
+            deques[self].tasks.pop_back();
+            found = true;
+        }
+    }
+    for (int k = 1; !found && k < threadCount; ++k) {
+        Deque& victim = deques[(self + k) % threadCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+    if (!found) return false;
+    task.fn();
+    task.group->pending.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    workerIndex() = index;
+    int idle = 0;
+    while (!stopping) {
+        if (runOne()) {
+            idle = 0;
+        } else if (++idle < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(idle < 4096 ? 50 : 1000));
+        }
+    }
+}
+
+// Runs fn(p) for p in [0, parts) as pool tasks and waits for all of them.
+template <typename F>
+void poolFor(WorkStealingPool& pool, int parts, F fn) {
+    TaskGroup group;
+    for (int p = 0; p < parts; ++p) pool.spawn(group, [&fn, p] { fn(p); });
+    pool.wait(group);
+}
+
+// Merge path: how many of the first d merged outputs come from L.
+template <typename T>
+int mergePathSplit(const T* L, int n1, const T* R, int n2, int d) {
+    int lo = std::max(0, d - n2), hi = std::min(d, n1);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (keyOf(L[mid]) <= keyOf(R[d - mid - 1])) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Merges segment `part` of `parts` equal slices of the output.
+template <typename T>
+void mergePathSegment(const T* L, int n1, const T* R, int n2, T* out, int part, int parts) {
+    int d0 = chunkBegin(n1 + n2, part, parts), d1 = chunkBegin(n1 + n2, part + 1, parts);
+    int i0 = mergePathSplit(L, n1, R, n2, d0), i1 = mergePathSplit(L, n1, R, n2, d1);
+    mergeRuns(L + i0, i1 - i0, R + (d0 - i0), (d1 - i1) - (d0 - i0), out + d0);
+}
+
+// Parallel merge sort: halves are forked onto the pool down to
+// PMERGE_FORK_CUTOFF, and merges producing at least two PMERGE_MERGE_GRAIN
+// slices are split by merge path so every slice merges independently.
+const int PMERGE_FORK_CUTOFF = 1 << 14;
+const int PMERGE_MERGE_GRAIN = 1 << 16;
+
+// Sorts src[0..n), leaving the result in dst when intoDst and in src
+// otherwise; the other array is scratch. Levels alternate between the two.
+template <typename T>
+void parallelMergeSortRec(T* src, T* dst, int n, bool intoDst, WorkStealingPool& pool) {
+    if (n <= SORTING_NETWORK_MAX) {
+        smallSort(src, n);
+        if (intoDst) std::copy(src, src + n, dst);
+        return;
+    }
+    int mid = n / 2;
+    if (n >= PMERGE_FORK_CUTOFF && pool.size() > 1) {
+        TaskGroup group;
+        pool.spawn(group, [=, &pool] { parallelMergeSortRec(src, dst, mid, !intoDst, pool); });
+        parallelMergeSortRec(src + mid, dst + mid, n - mid, !intoDst, pool);
+        pool.wait(group);
+    } else {
+        parallelMergeSortRec(src, dst, mid, !intoDst, pool);
+        parallelMergeSortRec(src + mid, dst + mid, n - mid, !intoDst, pool);
+    }
+    const T* from = intoDst ? src : dst;
+    T* to = intoDst ? dst : src;
+    int parts = pool.size() > 1 ? std::min(2 * pool.size(), n / PMERGE_MERGE_GRAIN) : 1;
+    if (parts > 1) {
+        TaskGroup group;
+        for (int p = 0; p < parts; ++p) {
+            pool.spawn(group, [=] { mergePathSegment(from, mid, from + mid, n - mid, to, p, parts); });
+        }
+        pool.wait(group);
+    } else {
+        mergeRuns(from, mid, from + mid, n - mid, to);
+    }
+}
+
+template <typename T>
+void parallelMergeSort(T* a, int n, WorkStealingPool& pool) {
+    std::vector<T> buf(n);
+    parallelMergeSortRec(a, buf.data(), n, false, pool);
+}
+
+// Sample sort
+// Splitters come from a sorted random sample of SAMPLE_OVERSAMPLING keys per
+// bucket. Each worker then classifies its chunk (remembering every element's
+// bucket) and counts per bucket, one prefix sum gives every (worker, bucket)
+// its output slot, the workers scatter, and buckets are sorted as
+// independent tasks. Only three pool-wide waits in total.
+const int SAMPLE_OVERSAMPLING = 32;
+const int SAMPLE_BUCKETS_PER_THREAD = 4;
+const int SAMPLE_SORT_CUTOFF = 1 << 16;
+
+template <typename T>
+std::vector<int> sampleSortSplitters(const T* a, int n, int buckets, int oversampling, std::mt19937& g,
+                                     std::vector<int>* sampled = nullptr) {
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    std::vector<int> sample(buckets * oversampling);
+    for (auto& s : sample) {
+        int i = pick(g);
+        if (sampled) sampled->push_back(i);
+        s = keyOf(a[i]);
+    }
+    std::sort(sample.begin(), sample.end());
+    std::vector<int> splitters(buckets - 1);
+    for (int b = 0; b + 1 < buckets; ++b) splitters[b] = sample[(b + 1) * oversampling - 1];
+    return splitters;
+}
+
+inline int sampleSortBucket(const std::vector<int>& splitters, int key) {
+    return (int)(std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin());
+}
+
+template <typename T>
+void parallelSampleSort(T* a, int n, WorkStealingPool& pool) {
+    if (n < SAMPLE_SORT_CUTOFF) {
+        parallelMergeSort(a, n, pool);
+        return;
+    }
+    const int threads = pool.size();
+    const int buckets = std::min(256, std::max(2, SAMPLE_BUCKETS_PER_THREAD * threads));
+    std::mt19937 g(n);
+    std::vector<int> splitters = sampleSortSplitters(a, n, buckets, SAMPLE_OVERSAMPLING, g);
+    std::vector<unsigned char> bucketOf(n);
+    std::vector<int> offsets(threads * buckets, 0);
+
+    poolFor(pool, threads, [&](int t) {
+        int* count = &offsets[t * buckets];
+        for (int i = chunkBegin(n, t, threads), end = chunkBegin(n, t + 1, threads); i < end; ++i) {
+            int b = sampleSortBucket(splitters, keyOf(a[i]));
+            bucketOf[i] = (unsigned char)b;
+            ++count[b];
+        }
+    });
+
+    std::vector<int> bucketStart(buckets + 1);
+    int sum = 0;
+    for (int b = 0; b < buckets; ++b) {
+        bucketStart[b] = sum;
+        for (int t = 0; t < threads; ++t) {
+            int c = offsets[t * buckets + b];
+            offsets[t * buckets + b] = sum;
+            sum += c;
+        }
+    }
+    bucketStart[buckets] = n;
+
+    std::vector<T> out(n);
+    poolFor(pool, threads, [&](int t) {
+        int* slot = &offsets[t * buckets];
+        for (int i = chunkBegin(n, t, threads), end = chunkBegin(n, t + 1, threads); i < end; ++i) {
+            out[slot[bucketOf[i]]++] = a[i];
+        }
+    });
+
+    // Each bucket is merge-sorted from `out` straight back into place in `a`.
+    poolFor(pool, buckets, [&](int b) {
+        int s = bucketStart[b];
+        parallelMergeSortRec(out.data() + s, a + s, bucketStart[b + 1] - s, true, pool);
+    });
+}
+
+// Vectorized partition
+// In-place scheme of Bramas' AVX-512 quicksort: the first and last vectors
+// of the range are held in registers, which leaves a vector's worth of free
+// space at each end. Each iteration loads from the side with less free
+// space, compares against the pivot and writes the "< pivot" lanes at the
+// left write cursor and the rest at the right one. The last few elements
+// and the two held vectors are distributed by a scalar tail.
+// Ranges shorter than two vectors use the scalar block partition.
+
+// Shared scalar tail: distributes tail[0..count) into the gap [writeL, writeR)
+// and moves the pivot from a[r] between the two sides.
+inline int finishVectorPartition(int* a, int r, int pivot, int writeL, int writeR, const int* tail, int count) {
+    for (int k = 0; k < count; ++k) {
+        if (tail[k] < pivot) {
+            a[writeL++] = tail[k];
+        } else {
+            a[--writeR] = tail[k];
+        }
+    }
+    std::swap(a[writeL], a[r]);
+    return writeL;
+}
+
+#ifdef SORTVIS_X86
+// For each 8-bit "lane < pivot" mask, a permutation moving those lanes to
+// the front in order and the remaining lanes behind them.
+inline const int* partitionPermutations() {
+    static int table[256][8];
+    static bool built = [] {
+        for (int m = 0; m < 256; ++m) {
+            int k = 0;
+            for (int lane = 0; lane < 8; ++lane) if (m >> lane & 1) table[m][k++] = lane;
+            for (int lane = 0; lane < 8; ++lane) if (!(m >> lane & 1)) table[m][k++] = lane;
+        }
+        return true;
+    }();
+    (void)built;
+    return &table[0][0];
+}
+
+// AVX2 has no compress store: the permuted vector is stored whole at both
+// cursors, the unwanted lanes landing in free space that is overwritten later.
+__attribute__((target("avx2"))) int simdPartitionAvx2(int* a, int l, int r) {
+    const int W = 8;
+    if (r - l < 2 * W) return blockPartition(a, l, r);
+    const int pivot = a[r];
+    const int* perms = partitionPermutations();
+    const __m256i pv = _mm256_set1_epi32(pivot);
+    __m256i first = _mm256_loadu_si256((const __m256i*)(a + l));
+    __m256i last = _mm256_loadu_si256((const __m256i*)(a + r - W));
+    int readL = l + W, readR = r - W, writeL = l, writeR = r;
+    while (readR - readL >= W) {
+        __m256i v;
+        if (readL - writeL <= writeR - readR) {
+            v = _mm256_loadu_si256((const __m256i*)(a + readL));
+            readL += W;
+        } else {
+            readR -= W;
+            v = _mm256_loadu_si256((const __m256i*)(a + readR));
+        }
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pv, v)));
+        __m256i p = _mm256_permutevar8x32_epi32(v, _mm256_loadu_si256((const __m256i*)(perms + mask * 8)));
+        _mm256_storeu_si256((__m256i*)(a + writeL), p);
+        _mm256_storeu_si256((__m256i*)(a + writeR - W), p);
+        int less = __builtin_popcount(mask);
+        writeL += less;
+        writeR -= W - less;
+    }
+    int tail[3 * W];
+    _mm256_storeu_si256((__m256i*)tail, first);
+    _mm256_storeu_si256((__m256i*)(tail + W), last);
+    std::copy(a + readL, a + readR, tail + 2 * W);
+    return finishVectorPartition(a, r, pivot, writeL, writeR, tail, 2 * W + (readR - readL));
+}
+
+__attribute__((target("avx512f"))) int simdPartitionAvx512(int* a, int l, int r) {
+    const int W = 16;
+    if (r - l < 2 * W) return blockPartition(a, l, r);
+    const int pivot = a[r];
+    const __m512i pv = _mm512_set1_epi32(pivot);
+    __m512i first = _mm512_loadu_si512(a + l);
+    __m512i last = _mm512_loadu_si512(a + r - W);
+    int readL = l + W, readR = r - W, writeL = l, writeR = r;
+    while (readR - readL >= W) {
+        __m512i v;
+        if (readL - writeL <= writeR - readR) {
+            v = _mm512_loadu_si512(a + readL);
+            readL += W;
+        } else {
+            readR -= W;
+            v = _mm512_loadu_si512(a + readR);
+        }
+        __mmask16 mask = _mm512_cmplt_epi32_mask(v, pv);
+        int less = __builtin_popcount(mask);
+        _mm512_mask_compressstoreu_epi32(a + writeL, mask, v);
+        _mm512_mask_compressstoreu_epi32(a + writeR - (W - less), (__mmask16)~mask, v);
+        writeL += less;
+        writeR -= W - less;
+    }
+    int tail[3 * W];
+    _mm512_storeu_si512(tail, first);
+    _mm512_storeu_si512(tail + W, last);
+    std::copy(a + readL, a + readR, tail + 2 * W);
+    return finishVectorPartition(a, r, pivot, writeL, writeR, tail, 2 * W + (readR - readL));
+}
+#endif
+
+// Partitions [l, r] around a[r] with the widest kernel `level` allows.
+inline int simdPartition(int* a, int l, int r, SimdLevel level) {
+#ifdef SORTVIS_X86
+    if (level >= SIMD_AVX512) return simdPartitionAvx512(a, l, r);
+    if (level >= SIMD_AVX2) return simdPartitionAvx2(a, l, r);
+#endif
+    (void)level;
+    return blockPartition(a, l, r);
+}
+
+inline void simdQuickSort(int* a, int n, SimdLevel level) {
+    quickSortWith(a, n, [level](int* x, int l, int r) { return simdPartition(x, l, r, level); });
+}
+
+// Vectorized merge
+// Inoue-style merge: one register holds the 8 largest elements seen so far;
+// each iteration loads 8 more from the input whose next key is smaller,
+// runs an 8+8 bitonic merge network (reverse, min/max, then the three
+// in-register half-cleaner levels) and stores the lower 8. The loop stops
+// when the input it should load from has less than a full vector left, and
+// the rest is merged by the scalar loop.
+#ifdef SORTVIS_X86
+__attribute__((target("avx2"))) void mergeIntsAvx2(const int* L, int n1, const int* R, int n2, int* out) {
+    const int W = 8;
+    if (n1 < W || n2 < W) {
+        mergeRuns<int>(L, n1, R, n2, out);
+        return;
+    }
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i high = _mm256_loadu_si256((const __m256i*)L);
+    __m256i next = _mm256_loadu_si256((const __m256i*)R);
+    int i = W, j = W, k = 0;
+    for (;;) {
+        __m256i rev = _mm256_permutevar8x32_epi32(high, reverse);
+        __m256i lo = bitonicSmallStagesAvx2(_mm256_min_epi32(next, rev), 16);
+        high = bitonicSmallStagesAvx2(_mm256_max_epi32(next, rev), 16);
+        _mm256_storeu_si256((__m256i*)(out + k), lo);
+        k += W;
+        bool takeL = j >= n2 || (i < n1 && L[i] <= R[j]);
+        if (takeL ? i + W > n1 : j + W > n2) break;
+        next = _mm256_loadu_si256((const __m256i*)(takeL ? L + i : R + j));
+        (takeL ? i : j) += W;
+    }
+    // `high` plus what is left of both inputs; at most one of them is long.
+    int tail[2 * W];
+    _mm256_storeu_si256((__m256i*)tail, high);
+    bool shortL = n1 - i < W;
+    int shortCount = shortL ? n1 - i : n2 - j;
+    int merged[2 * W];
+    mergeRuns<int>(tail, W, shortL ? L + i : R + j, shortCount, merged);
+    mergeRuns<int>(merged, W + shortCount, shortL ? R + j : L + i, shortL ? n2 - j : n1 - i, out + k);
+}
+#endif
+
+inline void mergeIntsSimd(const int* L, int n1, const int* R, int n2, int* out, SimdLevel level) {
+#ifdef SORTVIS_X86
+    if (level >= SIMD_AVX2) {
+        mergeIntsAvx2(L, n1, R, n2, out);
+        return;
+    }
+#endif
+    (void)level;
+    mergeRuns<int>(L, n1, R, n2, out);
+}
+
+void mergeRuns(const int* L, int n1, const int* R, int n2, int* out) {
+    static const SimdLevel level = detectSimdLevel();
+    mergeIntsSimd(L, n1, R, n2, out, level);
+}
+
+// Counting sort
+// One pass finds the key range, one builds the histogram (per-worker
+// histograms on a pool for large n), and an in-place prefix sum turns counts
+// into start offsets. Plain keys are then rewritten straight from the
+// histogram; other elements are scattered stably through a buffer. Gives up
+// when the histograms would exceed the memory budget.
+const size_t COUNTING_MEMORY_BUDGET = 64u << 20;
+const int COUNTING_PARALLEL_CUTOFF = 1 << 20;
+const int COUNTING_VIS_CHUNK = 5;
+
+template <typename T>
+void keyRange(const T* a, int n, int& lo, int& hi) {
+    lo = hi = keyOf(a[0]);
+    for (int i = 1; i < n; ++i) {
+        int k = keyOf(a[i]);
+        lo = std::min(lo, k);
+        hi = std::max(hi, k);
+    }
+}
+
+// Returns false, leaving a untouched, if the key range is too wide.
+template <typename T>
+bool countingSort(T* a, int n, WorkStealingPool* pool = nullptr, size_t budget = COUNTING_MEMORY_BUDGET) {
+    if (n < 2) return true;
+    int lo, hi;
+    keyRange(a, n, lo, hi);
+    long long range = (long long)hi - lo + 1;
+    if (range * (long long)sizeof(int) > (long long)budget) return false;
+    int workers = pool && n >= COUNTING_PARALLEL_CUTOFF ? pool->size() : 1;
+    if (range * workers * (long long)sizeof(int) > (long long)budget) workers = 1;
+    const int keys = (int)range;
+
+    // Worker t counts its chunk into count[t * keys ..]; the others are then
+    // folded into the first histogram, split by key.
+    std::vector<int> count((size_t)keys * workers, 0);
+    auto histogram = [&](int t) {
+        int* c = &count[(size_t)t * keys];
+        for (int i = chunkBegin(n, t, workers), end = chunkBegin(n, t + 1, workers); i < end; ++i) ++c[keyOf(a[i]) - lo];
+    };
+    auto fold = [&](int t) {
+        for (int k = chunkBegin(keys, t, workers), end = chunkBegin(keys, t + 1, workers); k < end; ++k) {
+            for (int w = 1; w < workers; ++w) count[k] += count[(size_t)w * keys + k];
+        }
+    };
+    if (workers > 1) {
+        poolFor(*pool, workers, histogram);
+        poolFor(*pool, workers, fold);
+    } else {
+        histogram(0);
+    }
+
+    int sum = 0;
+    for (int k = 0; k < keys; ++k) {
+        int c = count[k];
+        count[k] = sum;
+        sum += c;
+    }
+    if constexpr (std::is_same<T, int>::value) {
+        auto fill = [&](int t) {
+            for (int k = chunkBegin(keys, t, workers), end = chunkBegin(keys, t + 1, workers); k < end; ++k) {
+                std::fill(a + count[k], a + (k + 1 < keys ? count[k + 1] : n), lo + k);
+            }
+        };
+        if (workers > 1) {
+            poolFor(*pool, workers, fill);
+        } else {
+            fill(0);
+        }
+    } else {
+        std::vector<T> out(n);
+        for (int i = 0; i < n; ++i) out[count[keyOf(a[i]) - lo]++] = a[i];
+        std::copy(out.begin(), out.end(), a);
+    }
+    return true;
+}
+
+// Counting sort, or the in-place American flag sort when the range is too wide.
+template <typename T>
+void countingSortOrRadix(T* a, int n, WorkStealingPool* pool = nullptr) {
+    if (!countingSort(a, n, pool)) americanFlagSort(a, n);
+}
+
+// Flashsort (Neubert)
+// Keys are classified into m classes by linear interpolation between the
+// minimum and maximum key, the class sizes are prefix-summed into class
+// ends, and a cycle-leader permutation moves every element into its class
+// with no buffer: each displaced element is carried on to its own class,
+// whose unfilled part shrinks from the end, until the cycle returns to its
+// starting hole. A final insertion pass finishes each class. Uniform keys
+// give classes of about n / m elements and linear time; skewed keys pile
+// into a few classes, which are finished by the three-way quick sort once
+// they exceed FLASH_INSERTION_MAX so the pass cannot go quadratic.
+const double FLASH_CLASS_RATIO = 0.43;  // Neubert's m / n
+const int FLASH_INSERTION_MAX = 64;
+const int FLASH_VIS_CLASSES[] = {10, 5, 20, 43};
+
+inline int flashDefaultClasses(int n) { return std::max(1, (int)(FLASH_CLASS_RATIO * n)); }
+
+inline int flashClass(int key, int lo, int hi, int classes) {
+    return (int)((long long)(classes - 1) * ((long long)key - lo) / ((long long)hi - lo));
+}
+
+// Moves the element in hand to the unfilled end of its class and picks up
+// the one that was there; returns true when that slot was the cycle's hole.
+template <typename T>
+bool flashPlace(T* a, T& hand, int hole, std::vector<int>& end, int lo, int hi) {
+    int k = flashClass(keyOf(hand), lo, hi, (int)end.size());
+    std::swap(hand, a[--end[k]]);
+    return end[k] == hole;
+}
+
+// Histogram and class ends of a[0, n); lo < hi.
+template <typename T>
+std::vector<int> flashClassEnds(const T* a, int n, int lo, int hi, int classes) {
+    std::vector<int> end(classes, 0);
+    for (int i = 0; i < n; ++i) ++end[flashClass(keyOf(a[i]), lo, hi, classes)];
+    for (int k = 1; k < classes; ++k) end[k] += end[k - 1];
+    return end;
+}
+
+template <typename T>
+void flashSort(T* a, int n, int classes) {
+    if (n < 2) return;
+    int lo, hi;
+    keyRange(a, n, lo, hi);
+    if (lo == hi) return;
+    classes = std::max(1, std::min(classes, n));
+    std::vector<int> end = flashClassEnds(a, n, lo, hi, classes);
+    std::vector<int> classEnd = end;
+    int placed = 0, j = 0;
+    while (placed < n) {
+        while (j >= end[flashClass(keyOf(a[j]), lo, hi, classes)]) ++j;
+        T hand = a[j];
+        do {
+            ++placed;
+        } while (!flashPlace(a, hand, j, end, lo, hi));
+    }
+    // end[k] is now where class k starts.
+    for (int k = 0; k < classes; ++k) {
+        int size = classEnd[k] - end[k];
+        if (size <= FLASH_INSERTION_MAX) {
+            insertionSortRange(a + end[k], size);
+        } else {
+            threeWayQuickSort(a + end[k], size);
+        }
+    }
+}
+
+inline void bitonicSortInts(int* a, int n, SimdLevel level) {
+#ifdef SORTVIS_X86
+    if (level >= SIMD_AVX2) {
+        bitonicSortAvx2(a, n);
+        return;
+    }
+#endif
+    (void)level;
+    bitonicSort(a, n);
+}
+
+// Cost model
+// Counted wraps a key and tallies, per thread, reads and writes of the array
+// being measured (between countedBegin and countedEnd) and comparisons of
+// its keys. Temporaries, registers and scratch buffers are free, which
+// models a sort over expensive memory (persistent memory, flash-backed
+// mmap) with DRAM scratch. Every kernel is a template over the element
+// type, so they are measured unchanged.
+struct OpCounts {
+    long long reads = 0, writes = 0, compares = 0;
+};
+
+struct Counted;
+thread_local OpCounts countedOps;
+thread_local const Counted* countedBegin = nullptr;
+thread_local const Counted* countedEnd = nullptr;
+
+// p may point into an unrelated array, so the comparisons go through
+// std::less, which orders all pointers.
+inline bool isMeasured(const Counted* p) {
+    return !std::less<const Counted*>()(p, countedBegin) && std::less<const Counted*>()(p, countedEnd);
+}
+
+struct Counted {
+    int value;
+    Counted() : value(0) {}
+    explicit Counted(int v) : value(v) {}
+    Counted(const Counted& o) : value(o.value) {
+        if (isMeasured(&o)) ++countedOps.reads;
+    }
+    Counted& operator=(const Counted& o) {
+        if (isMeasured(&o)) ++countedOps.reads;
+        if (isMeasured(this)) ++countedOps.writes;
+        value = o.value;
+        return *this;
+    }
+};
+
+// A key read from a Counted; comparing it counts one comparison.
+struct CountedKey {
+    int value;
+    operator int() const { return value; }
+};
+
+inline CountedKey keyOf(const Counted& c) {
+    if (isMeasured(&c)) ++countedOps.reads;
+    return {c.value};
+}
+
+#define COUNTED_KEY_COMPARISON(op)                                                                              \
+    inline bool operator op(CountedKey a, CountedKey b) { ++countedOps.compares; return a.value op b.value; } \
+    inline bool operator op(CountedKey a, int b) { ++countedOps.compares; return a.value op b; }             \
+    inline bool operator op(int a, CountedKey b) { ++countedOps.compares; return a op b.value; }
+COUNTED_KEY_COMPARISON(<)
+COUNTED_KEY_COMPARISON(<=)
+COUNTED_KEY_COMPARISON(>)
+COUNTED_KEY_COMPARISON(>=)
+COUNTED_KEY_COMPARISON(==)
+COUNTED_KEY_COMPARISON(!=)
+#undef COUNTED_KEY_COMPARISON
+
+// Synthetic comparison cost: Delayed keys busy-wait compareDelayNs on every
+// comparison, standing in for expensive ones (long string keys, remote
+// lookups), so that timings show what comparison counts cost. Set with
+// --compare-ns=N; the counted alternative is --cost=R,W,C.
+long long compareDelayNs = 0;
+
+inline void spinFor(long long ns) {
+    if (ns <= 0) return;
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < until) {
+    }
+}
+
+struct Delayed {
+    int value;
+};
+struct DelayedKey {
+    int value;
+    operator int() const { return value; }
+};
+
+inline DelayedKey keyOf(const Delayed& d) { return {d.value}; }
+
+#define DELAYED_KEY_COMPARISON(op)                                                                                   \
+    inline bool operator op(DelayedKey a, DelayedKey b) { spinFor(compareDelayNs); return a.value op b.value; } \
+    inline bool operator op(DelayedKey a, int b) { spinFor(compareDelayNs); return a.value op b; }             \
+    inline bool operator op(int a, DelayedKey b) { spinFor(compareDelayNs); return a op b.value; }
+DELAYED_KEY_COMPARISON(<)
+DELAYED_KEY_COMPARISON(<=)
+DELAYED_KEY_COMPARISON(>)
+DELAYED_KEY_COMPARISON(>=)
+DELAYED_KEY_COMPARISON(==)
+DELAYED_KEY_COMPARISON(!=)
+#undef DELAYED_KEY_COMPARISON
+
+struct CostModel {
+    const char* name;
+    double read, write, compare;
+};
+
+const CostModel COST_MODELS[] = {
+    {"uniform", 1, 1, 1},
+    {"costly writes", 1, 20, 1},
+    {"costly compares", 1, 1, 20},
+};
+const int COST_MODEL_COUNT = sizeof(COST_MODELS) / sizeof(COST_MODELS[0]);
+
+inline double weightedCost(const OpCounts& ops, const CostModel& model) {
+    return ops.reads * model.read + ops.writes * model.write + ops.compares * model.compare;
+}
+
+// Parses "R,W,C" weights; false if malformed.
+inline bool parseCostModel(const char* text, CostModel& model) {
+    double r, w, c;
+    if (std::sscanf(text, "%lf,%lf,%lf", &r, &w, &c) != 3) return false;
+    model = {"custom", r, w, c};
+    return true;
+}
+
+// Runs the plain kernel behind each visualized algorithm; the parallel ones
+// on a single worker and the selection modes on their on-screen target.
+// Returns false if the algorithm has no kernel for T (the SIMD partition
+// only takes plain ints).
+template <typename T>
+bool runSortKernel(SortType type, T* a, int n) {
+    switch (type) {
+        case BUBBLE: bubbleSort(a, n); break;
+        case SELECTION: selectionSort(a, n); break;
+        case INSERTION: insertionSortSwaps(a, n); break;
+        case MERGE: bottomUpMergeSort(a, n); break;
+        case QUICK: lomutoQuickSort(a, n); break;
+        case AMERICAN_FLAG: americanFlagSort(a, n); break;
+        case BITONIC: bitonicSort(a, n); break;
+        case ODD_EVEN: oddEvenTranspositionSort(a, n, 1); break;
+        case PARALLEL_MERGE: {
+            WorkStealingPool pool(1);
+            parallelMergeSort(a, n, pool);
+            break;
+        }
+        case SAMPLE: {
+            WorkStealingPool pool(1);
+            parallelSampleSort(a, n, pool);
+            break;
+        }
+        case BLOCK_QUICK: blockQuickSort(a, n); break;
+        case SIMD_QUICK:
+            if constexpr (std::is_same<T, int>::value) {
+                simdQuickSort(a, n, detectSimdLevel());
+                break;
+            }
+            return false;
+        case CYCLE: cycleSort(a, n); break;
+        case COUNTING: countingSortOrRadix(a, n); break;
+        case BLOCK_MERGE: blockMergeSort(a, n); break;
+        case EXTERNAL: chunkedMergeSort(a, n, EXTERNAL_VIS_CHUNK); break;
+        case SHAKER: cocktailShakerSort(a, n); break;
+        case COMB: combSort(a, n); break;
+        case BINARY_INSERTION: binaryInsertionSort(a, n); break;
+        case SMOOTH: smoothsort(a, n); break;
+        case PATIENCE: patienceSort(a, n); break;
+        case THREE_WAY_QUICK: threeWayQuickSort(a, n); break;
+        case INTRO_SELECT: if (n > 0) introSelect(a, n, selectionTarget(type, n)); break;
+        case HEAP_TOP_K: heapTopK(a, n, selectionTarget(type, n)); break;
+        case PARTIAL_QUICK: partialQuickSort(a, n, selectionTarget(type, n)); break;
+        case MERGE_INSERTION: mergeInsertionSort(a, n); break;
+        case FLASH: flashSort(a, n, flashDefaultClasses(n)); break;
+        case FUNNEL: funnelSort(a, n); break;
+        case STD_SORT: std::sort(a, a + n, KeyLess()); break;
+        case STD_STABLE_SORT: std::stable_sort(a, a + n, KeyLess()); break;
+        case STD_PAR_SORT:
+#ifdef SORTVIS_PARALLEL_STL
+            // Counted keys tally on the calling thread only.
+            if constexpr (std::is_same<T, Counted>::value) {
+                return false;
+            } else {
+                std::sort(std::execution::par_unseq, a, a + n, KeyLess());
+            }
+#else
+            // No parallel backend: the sequential std::sort stands in.
+            std::sort(a, a + n, KeyLess());
+#endif
+            break;
+        default: return false;
+    }
+    return true;
+}
+
+// Operations kernel(a, n) performs on a Counted copy of keys.
+template <typename F>
+OpCounts measureKernelCost(F kernel, const std::vector<int>& keys) {
+    std::vector<Counted> a;
+    for (int k : keys) a.emplace_back(k);
+    countedOps = OpCounts();
+    countedBegin = a.data();
+    countedEnd = a.data() + a.size();
+    kernel(a.data(), (int)a.size());
+    countedBegin = countedEnd = nullptr;
+    return countedOps;
+}
+
+// Operation counts of sorting `keys` with the given algorithm.
+inline bool measureSortCost(SortType type, const std::vector<int>& keys, OpCounts& ops) {
+    bool ok = true;
+    ops = measureKernelCost([&](Counted* a, int n) { ok = runSortKernel(type, a, n); }, keys);
+    return ok;
+}
+
+// Weights used by the visualizer's title and the cost benchmark; set with
+// --cost=R,W,C or cycled with C in the visualizer.
+CostModel activeCostModel = COST_MODELS[0];
+
+class SortingVisualizer {
+public:
+    SortingVisualizer();
+    ~SortingVisualizer();
+    bool init();
+    void run();
+
+private:
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    std::vector<Bar> bars;
+    int speed;
+    SortType currentSort;
+    bool sorting;
+    bool paused;
+    bool sorted;
+    bool few_unique;
+
+    void resetBars();
+    void shuffleBars();
+    void drawBars();
+    void updateTitle();
+    void handleEvents();
+    void sortStep();
+
+    // Sorting helpers
+    int bubble_i, bubble_j, bubble_bound, bubble_last;
+    int shaker_lo, shaker_hi, shaker_j, shaker_last;
+    bool shaker_forward;
+    int comb_gap, comb_i;
+    bool comb_swapped;
+    int binary_i, binary_lo, binary_hi, binary_probe;
+    int selection_i, selection_j, selection_min;
+    int insertion_i, insertion_j;
+    int merge_size;
+    std::vector<std::pair<int, int>> quick_stack;
+    std::vector<std::pair<int, int>> three_way_stack;
+    std::pair<int, int> three_way_equal;
+    int select_lo, select_hi, select_budget;
+    int top_k_phase, top_k_i;
+    std::vector<std::pair<int, int>> partial_stack;
+    OpCounts select_reference;
+    int insertion_phase, insertion_pair, insertion_chain, insertion_next, insertion_lo, insertion_hi;
+    std::vector<int> insertion_label, insertion_order;
+    bool select_reference_known;
+    std::vector<RadixRange> flag_stack;
+    size_t flag_peak_aux;
+    int bitonic_k, bitonic_j, bitonic_stage;
+    int odd_even_phase;
+    int pmerge_width;
+    std::unique_ptr<WorkStealingPool> pool;
+    int sample_phase;
+    std::vector<int> sample_splitters;
+    std::vector<int> sample_bucket_start;
+    std::vector<std::pair<int, int>> block_quick_stack;
+    std::vector<std::pair<int, int>> simd_quick_stack;
+    int cycle_start;
+    int counting_phase, counting_pos, counting_key, counting_min;
+    std::vector<int> counting_hist;
+    BlockMergeLayout block_layout;
+    int block_phase, block_lo, block_run, block_buffer_at;
+    int external_phase, external_lo, external_out;
+    std::vector<std::vector<int>> external_runs;
+    std::vector<ArrayRun<int>> external_sources;
+    std::unique_ptr<LoserTree<ArrayRun<int>>> external_tree;
+    std::vector<int> external_replay;
+    LeonardoForest smooth_forest;
+    bool smooth_shrinking;
+    int patience_i, patience_out;
+    std::vector<int> patience_tops, patience_top_at;
+    std::vector<std::vector<int>> patience_piles;
+    std::vector<ArrayRun<int>> patience_runs;
+    std::unique_ptr<LoserTree<ArrayRun<int>>> patience_tree;
+    int flash_choice, flash_classes, flash_phase, flash_i, flash_hole, flash_hand, flash_placed, flash_min, flash_max;
+    bool flash_holding;
+    std::vector<int> flash_end, flash_class_end;
+    std::vector<std::pair<int, int>> funnel_tasks;
+    int funnel_task, funnel_out;
+    std::vector<int> funnel_data, funnel_refilled, funnel_arena;
+    std::unique_ptr<KFunnel<int>> funnel_tree;
+    double reference_us;
+    int cost_model;
+    OpCounts sort_cost;
+    bool sort_cost_known;
+
+    void initSortState();
+    void bubbleSortStep();
+    void shakerSortStep();
+    void combSortStep();
+    void binaryInsertionSortStep();
+    void selectionSortStep();
+    void insertionSortStep();
+    void mergeSortStep();
+    void quickSortStep();
+    void threeWayQuickSortStep();
+    void introSelectStep();
+    void heapTopKStep();
+    void partialQuickSortStep();
+    void mergeInsertionSortStep();
+    void americanFlagSortStep();
+    void bitonicSortStep();
+    void oddEvenSortStep();
+    void parallelMergeSortStep();
+    void sampleSortStep();
+    void blockQuickSortStep();
+    void simdQuickSortStep();
+    void cycleSortStep();
+    void countingSortStep();
+    void blockMergeSortStep();
+    void externalSortStep();
+    void smoothsortStep();
+    void patienceSortStep();
+    void flashSortStep();
+    void funnelSortStep();
+    void referenceSortStep();
+    void drawPatiencePiles();
+    void drawFlashClasses();
+    void drawFunnel();
+    void drawLoserTree();
+    void drawLeonardoForest();
+    void drawHistogram();
+};
+
+SortingVisualizer::SortingVisualizer() :
+    window(nullptr), renderer(nullptr), speed(15), currentSort(BUBBLE), sorting(false), paused(false), sorted(false), few_unique(false), flash_choice(0), cost_model(-1) {}
+
+SortingVisualizer::~SortingVisualizer() {
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (window) SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+bool SortingVisualizer::init() {
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) return false;
+    window = SDL_CreateWindow("Sorting Visualizer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE);
+    if (!window) return false;
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer) return false;
+    resetBars();
+    return true;
+}
+
+void SortingVisualizer::resetBars() {
+    bars.clear();
+    for (int i = 0; i < BAR_COUNT; ++i) {
+        int value = few_unique ? (i % FEW_UNIQUE_KEYS + 1) * BAR_COUNT / FEW_UNIQUE_KEYS : i + 1;
+        bars.push_back({ value, COLOR_BAR });
+    }
+    shuffleBars();
+    sorted = false;
+    sorting = false;
+    paused = false;
+    initSortState();
+}
+
+void SortingVisualizer::shuffleBars() {
+    std::random_device rd;
+    std::mt19937 g(rd());
+    std::shuffle(bars.begin(), bars.end(), g);
+}
+
+void SortingVisualizer::drawBars() {
+    SDL_SetRenderDrawColor(renderer, COLOR_BG.r, COLOR_BG.g, COLOR_BG.b, COLOR_BG.a);
+    SDL_RenderClear(renderer);
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    int barW = w / BAR_COUNT;
+    for (int i = 0; i < BAR_COUNT; ++i) {
+        SDL_Rect rect = { i * barW, h - (bars[i].value * (h - 40) / BAR_COUNT), barW - 1, (bars[i].value * (h - 40) / BAR_COUNT) };
+        SDL_SetRenderDrawColor(renderer, bars[i].color.r, bars[i].color.g, bars[i].color.b, bars[i].color.a);
+        SDL_RenderFillRect(renderer, &rect);
+    }
+    if (currentSort == COUNTING && sorting) drawHistogram();
+    if (currentSort == EXTERNAL && sorting && external_tree) drawLoserTree();
+    if (currentSort == SMOOTH && sorting) drawLeonardoForest();
+    if (currentSort == PATIENCE && sorting) drawPatiencePiles();
+    if (currentSort == FLASH && sorting) drawFlashClasses();
+    if (currentSort == FUNNEL && sorting && funnel_tree) drawFunnel();
+    SDL_RenderPresent(renderer);
+}
+
+// Draws the counting sort histogram in the strip above the tallest bar, one
+// column per key so each count sits over the slots its key will fill.
+void SortingVisualizer::drawHistogram() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    int keys = (int)counting_hist.size();
+    int colW = std::max(1, w / keys);
+    int peak = std::max(1, *std::max_element(counting_hist.begin(), counting_hist.end()));
+    SDL_SetRenderDrawColor(renderer, COLOR_BOUNDARY.r, COLOR_BOUNDARY.g, COLOR_BOUNDARY.b, COLOR_BOUNDARY.a);
+    for (int k = 0; k < keys; ++k) {
+        SDL_Rect rect = { k * colW, 0, std::max(1, colW - 1), counting_hist[k] * 36 / peak };
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+// Draws the Leonardo heap forest above the bars: one block per tree over
+// the bars it holds, taller for higher orders, in the tree's color.
+void SortingVisualizer::drawLeonardoForest() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    int barW = w / BAR_COUNT;
+    auto trees = leonardoTrees(smooth_forest);
+    for (size_t t = 0; t < trees.size(); ++t) {
+        const SDL_Color& c = THREAD_COLORS[t % THREAD_COLOR_COUNT];
+        SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+        SDL_Rect rect = { trees[t].first * barW, 0, LEONARDO.value[trees[t].second] * barW - 2, 4 + 3 * trees[t].second };
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+// Draws the patience piles above the bars, left to right, each as tall as
+// the cards it still holds relative to the largest pile.
+void SortingVisualizer::drawPatiencePiles() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    int piles = (int)patience_piles.size();
+    if (piles == 0) return;
+    auto cards = [&](int p) {
+        return patience_tree ? (int)(patience_runs[p].end - patience_runs[p].next) : (int)patience_piles[p].size();
+    };
+    int largest = 1;
+    for (int p = 0; p < piles; ++p) largest = std::max(largest, (int)patience_piles[p].size());
+    int colW = std::max(1, std::min(3 * (w / BAR_COUNT), w / piles));
+    for (int p = 0; p < piles; ++p) {
+        const SDL_Color& c = THREAD_COLORS[p % THREAD_COLOR_COUNT];
+        SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+        SDL_Rect rect = { p * colW, 0, std::max(1, colW - 1), cards(p) * 36 / largest };
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+// Draws the funnel above the bars like the loser tree, one block per
+// internal node filled to its buffer's share of its capacity; nodes refilled
+// by the last output element are yellow.
+void SortingVisualizer::drawFunnel() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    for (int j = 1; j < funnel_tree->size(); ++j) {
+        int depth = 0;
+        while ((2 << depth) <= j) ++depth;
+        int slots = 1 << depth, slot = j - slots;
+        SDL_Rect rect = { (2 * slot + 1) * w / (2 * slots) - 8, 2 + depth * 9, 16, 7 };
+        SDL_SetRenderDrawColor(renderer, COLOR_BAR.r, COLOR_BAR.g, COLOR_BAR.b, COLOR_BAR.a);
+        SDL_RenderFillRect(renderer, &rect);
+        bool refilled = std::find(funnel_refilled.begin(), funnel_refilled.end(), j) != funnel_refilled.end();
+        const SDL_Color& c = refilled ? COLOR_COMPARE : COLOR_BOUNDARY;
+        rect.w = funnel_tree->capacity(j) ? 16 * funnel_tree->buffered(j) / funnel_tree->capacity(j) : 0;
+        SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+// Draws the flashsort classes above the bars: each class spans the slots
+// its count reserves so far, filled up to the elements already placed, with
+// a purple boundary line down to the bars where each class starts.
+void SortingVisualizer::drawFlashClasses() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    int barW = w / BAR_COUNT;
+    for (int k = 0, start = 0; k < flash_classes; ++k) {
+        int end = flash_phase == 0 ? start + flash_end[k] : flash_class_end[k];
+        int filled = flash_phase == 0 ? 0 : flash_phase == 2 ? end - flash_end[k] : end - start;
+        const SDL_Color& c = THREAD_COLORS[k % THREAD_COLOR_COUNT];
+        SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+        SDL_Rect span = { start * barW, 0, std::max(1, (end - start) * barW - 1), 6 };
+        SDL_RenderFillRect(renderer, &span);
+        if (filled > 0) {
+            SDL_Rect fill = { (end - filled) * barW, 6, filled * barW - 1, 30 };
+            SDL_RenderFillRect(renderer, &fill);
+        }
+        if (start > 0 && start < end) {
+            SDL_SetRenderDrawColor(renderer, COLOR_BOUNDARY.r, COLOR_BOUNDARY.g, COLOR_BOUNDARY.b, COLOR_BOUNDARY.a);
+            SDL_RenderDrawLine(renderer, start * barW - 1, 0, start * barW - 1, h);
+        }
+        start = end;
+    }
+}
+
+void SortingVisualizer::updateTitle() {
+    std::string title = std::string("Sorting Visualizer - ") + SORT_NAMES[currentSort];
+    if (few_unique) title += " (" + std::to_string(FEW_UNIQUE_KEYS) + " distinct keys)";
+    if (currentSort == BUBBLE) {
+        title += " | pass " + std::to_string(bubble_i + 1) + ", " + std::to_string(BAR_COUNT - 1 - bubble_bound) + " final at the end";
+    } else if (currentSort == SHAKER) {
+        title += std::string(" | ") + (shaker_forward ? "forward" : "backward") + " pass over [" + std::to_string(shaker_lo) +
+                 ", " + std::to_string(shaker_hi) + "]";
+    } else if (currentSort == BINARY_INSERTION && binary_i < BAR_COUNT) {
+        title += " | inserting bar " + std::to_string(binary_i) + ", search range [" + std::to_string(binary_lo) + ", " +
+                 std::to_string(binary_hi) + ")";
+    } else if (currentSort == SMOOTH) {
+        std::string orders;
+        for (const auto& tree : leonardoTrees(smooth_forest)) orders += " " + std::to_string(tree.second);
+        title += std::string(" | ") + (smooth_shrinking ? "dismantling" : "building") + ", tree orders" + orders;
+    } else if (currentSort == PATIENCE) {
+        int piles = (int)patience_piles.size();
+        if (patience_tree) {
+            title += " | merging " + std::to_string(piles) + " piles: LIS " + std::to_string(piles) + ", Rem " + std::to_string(BAR_COUNT - piles);
+        } else {
+            title += " | dealing bar " + std::to_string(patience_i) + ", " + std::to_string(piles) + " piles";
+        }
+    } else if (currentSort == QUICK) {
+        title += " | stack " + std::to_string(quick_stack.size());
+    } else if (currentSort == THREE_WAY_QUICK) {
+        title += " | equal block of " + std::to_string(three_way_equal.second - three_way_equal.first + 1) + ", stack " +
+                 std::to_string(three_way_stack.size());
+    } else if (currentSort == INTRO_SELECT) {
+        title += " | rank " + std::to_string(selectionTarget(INTRO_SELECT, BAR_COUNT)) + ", range [" + std::to_string(select_lo) +
+                 ", " + std::to_string(select_hi) + "], " + std::to_string(select_budget) + " partitions before heap select";
+    } else if (currentSort == HEAP_TOP_K) {
+        const char* phases[] = {"heapify", "scan", "sort the heap"};
+        title += " | k = " + std::to_string(selectionTarget(HEAP_TOP_K, BAR_COUNT)) + ", " + phases[top_k_phase];
+    } else if (currentSort == PARTIAL_QUICK) {
+        title += " | k = " + std::to_string(selectionTarget(PARTIAL_QUICK, BAR_COUNT)) + ", stack " + std::to_string(partial_stack.size());
+    } else if (currentSort == MERGE_INSERTION) {
+        title += " | ";
+        if (insertion_phase == 0) {
+            title += "pairing " + std::to_string(insertion_pair) + " of " + std::to_string(BAR_COUNT / 2);
+        } else if (insertion_next < (int)insertion_order.size()) {
+            title += "inserting b" + std::to_string(insertion_order[insertion_next]) + " into a chain of " + std::to_string(insertion_chain);
+        } else {
+            title += "done";
+        }
+        title += ", log2(n!) bound " + std::to_string(comparisonLowerBound(BAR_COUNT)) + " compares";
+    } else if (currentSort == FLASH) {
+        const char* phases[] = {"classifying", "class ends", "cycle-leader permutation", "insertion pass"};
+        title += " | " + std::to_string(flash_classes) + " classes, " + phases[flash_phase];
+        if (flash_phase == 2) title += ", " + std::to_string(flash_placed) + " of " + std::to_string(BAR_COUNT) + " placed";
+    } else if (currentSort == FUNNEL && funnel_task < (int)funnel_tasks.size()) {
+        int n = funnel_tasks[funnel_task].second;
+        if (n > FUNNEL_VIS_BASE) {
+            int refills = 0;
+            for (int j = 1; funnel_tree && j < funnel_tree->size(); ++j) refills += funnel_tree->refills(j);
+            title += " | merging " + std::to_string((n + funnelSegment(n) - 1) / funnelSegment(n)) + " runs of " +
+                     std::to_string(n) + " through a funnel, " + std::to_string(funnel_out) + " out, " + std::to_string(refills) +
+                     " buffer refills";
+        } else {
+            title += " | sorting a base segment of " + std::to_string(n);
+        }
+    } else if (isReferenceSort(currentSort)) {
+        if (sorted) {
+            char took[64];
+            std::snprintf(took, sizeof(took), " | whole sort in one step: %.1f us", reference_us);
+            title += took;
+        }
+#ifndef SORTVIS_PARALLEL_STL
+        if (currentSort == STD_PAR_SORT) title += " | sequential (build with -DSORTVIS_PARALLEL_STL)";
+#endif
+    } else if (currentSort == COMB) {
+        title += " | gap " + std::to_string(comb_gap);
+    } else if (currentSort == AMERICAN_FLAG) {
+        title += " | aux memory: " + std::to_string(flag_peak_aux) + " B peak";
+    } else if (currentSort == BITONIC) {
+        int levels = 0;
+        while ((1 << levels) < BAR_COUNT) ++levels;
+        title += " | stage " + std::to_string(bitonic_stage) + " of " + std::to_string(levels * (levels + 1) / 2);
+    } else if (currentSort == ODD_EVEN) {
+        title += " | phase " + std::to_string(odd_even_phase) + " of " + std::to_string(BAR_COUNT) + ", " +
+                 std::to_string(VIS_THREAD_COUNT) + " workers";
+    } else if (currentSort == PARALLEL_MERGE) {
+        title += " | run width " + std::to_string(pmerge_width) + ", " + std::to_string(VIS_THREAD_COUNT) + " workers";
+    } else if (currentSort == COUNTING) {
+        title += std::string(" | ") + (counting_phase == 0 ? "histogram fill" : "output write") + ", " +
+                 std::to_string(counting_hist.size()) + " keys in range";
+    } else if (currentSort == BLOCK_MERGE && block_phase > 0) {
+        title += " | " + std::to_string(block_layout.keys) + " keys" + (block_layout.tagged ? " (tags + buffer)" : " (buffer only)");
+        if (block_phase == 2) title += ", run " + std::to_string(block_run);
+        title += ", aux memory: 0 B";
+    } else if (currentSort == EXTERNAL) {
+        int runs = (BAR_COUNT + EXTERNAL_VIS_CHUNK - 1) / EXTERNAL_VIS_CHUNK;
+        if (external_phase == 0) {
+            title += " | run generation: " + std::to_string(external_runs.size()) + " of " + std::to_string(runs) +
+                     " runs spilled, budget " + std::to_string(EXTERNAL_VIS_CHUNK) + " bars";
+        } else {
+            title += " | " + std::to_string(runs) + "-way loser tree merge, " + std::to_string(external_out) + " of " +
+                     std::to_string(BAR_COUNT) + " written, " + std::to_string(external_replay.size()) + " matches replayed";
+        }
+    } else if (currentSort == SIMD_QUICK) {
+        title += std::string(" | partition kernel: ") + SIMD_NAMES[detectSimdLevel()];
+    } else if (currentSort == SAMPLE) {
+        const char* phases[] = {"sampling", "classification", "scatter"};
+        title += " | ";
+        title += sample_phase < 3 ? phases[sample_phase] : "sorting bucket " + std::to_string(sample_phase - 2);
+    }
+    if (sort_cost_known && select_reference_known) {
+        auto share = [](long long part, long long whole) { return std::to_string(whole ? part * 100 / whole : 100) + "%"; };
+        title += " | " + share(sort_cost.compares, select_reference.compares) + " of the compares, " +
+                 share(sort_cost.writes, select_reference.writes) + " of the writes of " +
+                 (currentSort == HEAP_TOP_K ? "Heap Sort" : SORT_NAMES[THREE_WAY_QUICK]);
+    }
+    const CostModel& model = cost_model < 0 ? activeCostModel : COST_MODELS[cost_model];
+    if (sort_cost_known) {
+        char cost[160];
+        std::snprintf(cost, sizeof(cost), " | cost %.0f (%s): %lld reads, %lld writes, %lld compares", weightedCost(sort_cost, model),
+                      model.name, sort_cost.reads, sort_cost.writes, sort_cost.compares);
+        title += cost;
+    } else {
+        title += std::string(" | cost (") + model.name + "): n/a";
+    }
+    SDL_SetWindowTitle(window, title.c_str());
+}
+
+void SortingVisualizer::handleEvents() {
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+        if (e.type == SDL_QUIT) {
+            exit(0);
+        } else if (e.type == SDL_KEYDOWN) {
+            switch (e.key.keysym.sym) {
+                case SDLK_ESCAPE: exit(0); break;
+                case SDLK_SPACE: sorting = !sorting; break;
+                case SDLK_r: resetBars(); break;
+                case SDLK_s: shuffleBars(); sorted = false; sorting = false; paused = false; initSortState(); break;
+                case SDLK_RIGHT: currentSort = (SortType)((currentSort + 1) % SORT_COUNT); resetBars(); break;
+                case SDLK_LEFT: currentSort = (SortType)((currentSort - 1 + SORT_COUNT) % SORT_COUNT); resetBars(); break;
+                case SDLK_UP: speed = std::max(1, speed - 5); break;
+                case SDLK_DOWN: speed = std::min(100, speed + 5); break;
+                case SDLK_p: paused = !paused; break;
+                case SDLK_u: few_unique = !few_unique; resetBars(); break;
+                case SDLK_f:
+                    flash_choice = (flash_choice + 1) % (int)(sizeof(FLASH_VIS_CLASSES) / sizeof(FLASH_VIS_CLASSES[0]));
+                    if (currentSort == FLASH) resetBars();
+                    break;
+                case SDLK_c: cost_model = (cost_model + 1) % COST_MODEL_COUNT; updateTitle(); break;
+            }
+        }
+    }
+}
+
+void SortingVisualizer::initSortState() {
+    bubble_i = bubble_j = bubble_last = 0;
+    bubble_bound = BAR_COUNT - 1;
+    shaker_lo = shaker_j = shaker_last = 0;
+    shaker_hi = BAR_COUNT - 1;
+    shaker_forward = true;
+    comb_gap = nextCombGap(BAR_COUNT);
+    comb_i = 0;
+    comb_swapped = false;
+    binary_i = binary_hi = 1;
+    binary_lo = 0;
+    binary_probe = -1;
+    smooth_forest = LeonardoForest();
+    smooth_shrinking = false;
+    patience_i = patience_out = 0;
+    patience_tops.clear();
+    patience_top_at.clear();
+    patience_piles.clear();
+    patience_runs.clear();
+    patience_tree.reset();
+    flash_classes = FLASH_VIS_CLASSES[flash_choice];
+    flash_phase = flash_i = flash_hole = flash_hand = flash_placed = 0;
+    flash_holding = false;
+    keyRange(bars.data(), BAR_COUNT, flash_min, flash_max);
+    flash_end.assign(flash_classes, 0);
+    flash_class_end.clear();
+    funnel_tasks.clear();
+    std::function<void(int, int)> plan = [&](int lo, int n) {
+        if (n > FUNNEL_VIS_BASE) {
+            int segment = funnelSegment(n);
+            for (int s = lo; s < lo + n; s += segment) plan(s, std::min(segment, lo + n - s));
+        }
+        funnel_tasks.push_back({lo, n});
+    };
+    plan(0, BAR_COUNT);
+    funnel_task = funnel_out = 0;
+    funnel_data.clear();
+    funnel_refilled.clear();
+    funnel_tree.reset();
+    reference_us = 0;
+    selection_i = selection_j = selection_min = 0;
+    insertion_i = 1; insertion_j = 0;
+    merge_size = 1;
+    quick_stack.clear();
+    quick_stack.push_back({0, BAR_COUNT - 1});
+    three_way_stack.clear();
+    three_way_stack.push_back({0, BAR_COUNT - 1});
+    three_way_equal = {0, -1};
+    select_lo = 0;
+    select_hi = BAR_COUNT - 1;
+    select_budget = 0;
+    for (int m = BAR_COUNT; m > 1; m /= 2) select_budget += 2;
+    top_k_phase = 0;
+    top_k_i = selectionTarget(HEAP_TOP_K, BAR_COUNT);
+    partial_stack.clear();
+    partial_stack.push_back({0, BAR_COUNT - 1});
+    insertion_phase = insertion_pair = insertion_chain = insertion_next = insertion_lo = 0;
+    insertion_hi = -1;
+    insertion_label.clear();
+    insertion_order.clear();
+    flag_stack.clear();
+    flag_peak_aux = 0;
+    int shift = radixStartShift(bars.data(), BAR_COUNT, FLAG_VIS_RADIX_BITS);
+    if (shift >= 0) flag_stack.push_back({0, BAR_COUNT, shift});
+    bitonic_k = 2; bitonic_j = 1; bitonic_stage = 0;
+    odd_even_phase = 0;
+    pmerge_width = 1;
+    pool.reset();
+    sample_phase = 0;
+    sample_splitters.clear();
+    sample_bucket_start.clear();
+    block_quick_stack.clear();
+    block_quick_stack.push_back({0, BAR_COUNT - 1});
+    simd_quick_stack.clear();
+    simd_quick_stack.push_back({0, BAR_COUNT - 1});
+    cycle_start = 0;
+    int countingMax;
+    keyRange(bars.data(), BAR_COUNT, counting_min, countingMax);
+    counting_hist.assign(countingMax - counting_min + 1, 0);
+    counting_phase = counting_pos = counting_key = 0;
+    block_phase = block_lo = block_run = block_buffer_at = 0;
+    external_phase = external_lo = external_out = 0;
+    external_runs.clear();
+    external_sources.clear();
+    external_tree.reset();
+    external_replay.clear();
+    std::vector<int> keys;
+    for (const auto& bar : bars) keys.push_back(bar.value);
+    // Flashsort and funnelsort are counted with the class count and base
+    // case shown on screen rather than the kernel defaults.
+    sort_cost_known = true;
+    if (currentSort == FLASH) {
+        int classes = flash_classes;
+        sort_cost = measureKernelCost([classes](Counted* a, int n) { flashSort(a, n, classes); }, keys);
+    } else if (currentSort == FUNNEL) {
+        sort_cost = measureKernelCost([](Counted* a, int n) { funnelSort(a, n, FUNNEL_VIS_BASE); }, keys);
+    } else {
+        sort_cost_known = measureSortCost(currentSort, keys, sort_cost);
+    }
+    select_reference_known = false;
+    if (currentSort == HEAP_TOP_K) {
+        select_reference = measureKernelCost([](Counted* a, int n) { heapSort(a, n); }, keys);
+        select_reference_known = true;
+    } else if (isSelectionMode(currentSort)) {
+        select_reference_known = measureSortCost(THREE_WAY_QUICK, keys, select_reference);
+    }
+    updateTitle();
+}
+
+void SortingVisualizer::sortStep() {
+    switch (currentSort) {
+        case BUBBLE: bubbleSortStep(); break;
+        case SHAKER: shakerSortStep(); break;
+        case COMB: combSortStep(); break;
+        case BINARY_INSERTION: binaryInsertionSortStep(); break;
+        case SELECTION: selectionSortStep(); break;
+        case INSERTION: insertionSortStep(); break;
+        case MERGE: mergeSortStep(); break;
+        case QUICK: quickSortStep(); break;
+        case THREE_WAY_QUICK: threeWayQuickSortStep(); break;
+        case INTRO_SELECT: introSelectStep(); break;
+        case HEAP_TOP_K: heapTopKStep(); break;
+        case PARTIAL_QUICK: partialQuickSortStep(); break;
+        case MERGE_INSERTION: mergeInsertionSortStep(); break;
+        case AMERICAN_FLAG: americanFlagSortStep(); break;
+        case BITONIC: bitonicSortStep(); break;
+        case ODD_EVEN: oddEvenSortStep(); break;
+        case PARALLEL_MERGE: parallelMergeSortStep(); break;
+        case SAMPLE: sampleSortStep(); break;
+        case BLOCK_QUICK: blockQuickSortStep(); break;
+        case SIMD_QUICK: simdQuickSortStep(); break;
+        case CYCLE: cycleSortStep(); break;
+        case COUNTING: countingSortStep(); break;
+        case BLOCK_MERGE: blockMergeSortStep(); break;
+        case EXTERNAL: externalSortStep(); break;
+        case SMOOTH: smoothsortStep(); break;
+        case PATIENCE: patienceSortStep(); break;
+        case FLASH: flashSortStep(); break;
+        case FUNNEL: funnelSortStep(); break;
+        case STD_SORT:
+        case STD_STABLE_SORT:
+        case STD_PAR_SORT: referenceSortStep(); break;
+        default: break;
+    }
+}
+
+// Bars past the bound are final and drawn sorted; a pass without swaps ends
+// the sort.
+void SortingVisualizer::bubbleSortStep() {
+    if (bubble_bound > 0) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = k > bubble_bound ? COLOR_SORTED : COLOR_BAR;
+        bars[bubble_j].color = COLOR_COMPARE;
+        bars[bubble_j + 1].color = COLOR_COMPARE;
+        if (bars[bubble_j].value > bars[bubble_j + 1].value) {
+            std::swap(bars[bubble_j], bars[bubble_j + 1]);
+            bars[bubble_j].color = COLOR_SWAP;
+            bars[bubble_j + 1].color = COLOR_SWAP;
+            bubble_last = bubble_j;
+        }
+        if (++bubble_j >= bubble_bound) {
+            ++bubble_i;
+            bubble_bound = bubble_last;
+            bubble_j = bubble_last = 0;
+            updateTitle();
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// Bars outside [lo, hi] are final.
+void SortingVisualizer::shakerSortStep() {
+    if (shaker_lo < shaker_hi) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = k < shaker_lo || k > shaker_hi ? COLOR_SORTED : COLOR_BAR;
+        int left = shaker_forward ? shaker_j : shaker_j - 1;
+        bars[left].color = COLOR_COMPARE;
+        bars[left + 1].color = COLOR_COMPARE;
+        if (bars[left].value > bars[left + 1].value) {
+            std::swap(bars[left], bars[left + 1]);
+            bars[left].color = COLOR_SWAP;
+            bars[left + 1].color = COLOR_SWAP;
+            shaker_last = shaker_j;
+        }
+        if (shaker_forward && ++shaker_j >= shaker_hi) {
+            shaker_hi = shaker_j = shaker_last;
+            shaker_forward = false;
+            updateTitle();
+        } else if (!shaker_forward && --shaker_j <= shaker_lo) {
+            shaker_lo = shaker_j = shaker_last;
+            shaker_forward = true;
+            updateTitle();
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+void SortingVisualizer::combSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (comb_i + comb_gap < BAR_COUNT) {
+        bars[comb_i].color = COLOR_COMPARE;
+        bars[comb_i + comb_gap].color = COLOR_COMPARE;
+        if (bars[comb_i].value > bars[comb_i + comb_gap].value) {
+            std::swap(bars[comb_i], bars[comb_i + comb_gap]);
+            bars[comb_i].color = COLOR_SWAP;
+            bars[comb_i + comb_gap].color = COLOR_SWAP;
+            comb_swapped = true;
+        }
+        ++comb_i;
+    } else if (comb_gap > 1 || comb_swapped) {
+        comb_gap = nextCombGap(comb_gap);
+        comb_i = 0;
+        comb_swapped = false;
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One step adds the next bar to the forest (growing) or takes the largest
+// root off its right end (shrinking). Each tree's bars are drawn in its own
+// color with the root in purple; bars past the forest are unvisited while
+// growing and final while shrinking.
+void SortingVisualizer::smoothsortStep() {
+    if (!smooth_shrinking) {
+        if (smooth_forest.head < BAR_COUNT - 1) {
+            smoothsortGrow(bars.data(), BAR_COUNT, smooth_forest);
+        } else {
+            leonardoTrinkle(bars.data(), smooth_forest.head, smooth_forest.p, smooth_forest.pshift, false);
+            smooth_shrinking = true;
+        }
+    } else if (!smoothsortDone(smooth_forest)) {
+        smoothsortShrink(bars.data(), smooth_forest);
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+        return;
+    }
+    for (int k = smooth_forest.head + 1; k < BAR_COUNT; ++k) bars[k].color = smooth_shrinking ? COLOR_SORTED : COLOR_BAR;
+    auto trees = leonardoTrees(smooth_forest);
+    for (size_t t = 0; t < trees.size(); ++t) {
+        int end = trees[t].first + LEONARDO.value[trees[t].second];
+        for (int k = trees[t].first; k < end; ++k) bars[k].color = THREAD_COLORS[t % THREAD_COLOR_COUNT];
+        bars[end - 1].color = COLOR_BOUNDARY;
+    }
+    updateTitle();
+}
+
+// Dealing colors each bar by its pile and marks the current pile tops in
+// purple; merging works like the External Merge Sort view, with the cards
+// left on every pile laid out after the output in the pile's color.
+void SortingVisualizer::patienceSortStep() {
+    if (patience_i < BAR_COUNT) {
+        int p = patienceDeal(patience_tops, bars[patience_i].value);
+        if (p == (int)patience_piles.size()) {
+            patience_piles.emplace_back();
+            patience_top_at.push_back(-1);
+        }
+        patience_piles[p].push_back(bars[patience_i].value);
+        if (patience_top_at[p] >= 0) bars[patience_top_at[p]].color = THREAD_COLORS[p % THREAD_COLOR_COUNT];
+        patience_top_at[p] = patience_i;
+        bars[patience_i++].color = COLOR_BOUNDARY;
+        if (patience_i == BAR_COUNT) {
+            patience_runs = patienceRuns(patience_piles);
+            patience_tree.reset(new LoserTree<ArrayRun<int>>(patience_runs));
+        }
+    } else if (patience_out < BAR_COUNT) {
+        for (int k = 0; k < patience_out; ++k) bars[k].color = COLOR_SORTED;
+        bars[patience_out++] = { patience_tree->pop(), COLOR_SWAP };
+        int k = patience_out;
+        for (int p = 0; p < (int)patience_runs.size(); ++p) {
+            for (const int* x = patience_runs[p].next; x != patience_runs[p].end; ++x) {
+                bars[k++] = { *x, THREAD_COLORS[p % THREAD_COLOR_COUNT] };
+            }
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+    updateTitle();
+}
+
+// One bar classified per step, then the class ends, then one placement of
+// the cycle leader per step (the hole it started from in red, the slot just
+// written in yellow), then one class insertion-sorted per step. Bars take
+// their class color once classified.
+void SortingVisualizer::flashSortStep() {
+    auto classOf = [&](int v) { return flash_min == flash_max ? 0 : flashClass(v, flash_min, flash_max, flash_classes); };
+    auto classColor = [&](int v) { return THREAD_COLORS[classOf(v) % THREAD_COLOR_COUNT]; };
+    if (flash_phase == 0) {
+        if (flash_i > 0) bars[flash_i - 1].color = classColor(bars[flash_i - 1].value);
+        ++flash_end[classOf(bars[flash_i].value)];
+        bars[flash_i++].color = COLOR_COMPARE;
+        if (flash_i == BAR_COUNT) flash_phase = 1;
+    } else if (flash_phase == 1) {
+        bars[BAR_COUNT - 1].color = classColor(bars[BAR_COUNT - 1].value);
+        for (int k = 1; k < flash_classes; ++k) flash_end[k] += flash_end[k - 1];
+        flash_class_end = flash_end;
+        for (auto& bar : bars) bar.color = COLOR_BAR;
+        flash_phase = 2;
+        flash_i = -1;
+    } else if (flash_phase == 2) {
+        if (flash_i >= 0) bars[flash_i].color = classColor(bars[flash_i].value);
+        if (!flash_holding) {
+            while (flash_hole >= flash_end[classOf(bars[flash_hole].value)]) ++flash_hole;
+            flash_hand = bars[flash_hole].value;
+            flash_holding = true;
+            bars[flash_hole].color = COLOR_SWAP;
+        }
+        int k = classOf(flash_hand);
+        int slot = --flash_end[k];
+        std::swap(flash_hand, bars[slot].value);
+        bars[slot].color = COLOR_COMPARE;
+        flash_i = slot;
+        ++flash_placed;
+        if (slot == flash_hole) flash_holding = false;
+        if (flash_placed == BAR_COUNT) {
+            flash_phase = 3;
+            flash_i = 0;
+        }
+    } else if (flash_i < flash_classes) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = classColor(bars[k].value);
+        for (int k = 0; k < flash_i; ++k) {
+            for (int x = flash_end[k]; x < flash_class_end[k]; ++x) bars[x].color = COLOR_SORTED;
+        }
+        int start = flash_end[flash_i], size = flash_class_end[flash_i] - start;
+        insertionSortRange(bars.data() + start, size);
+        for (int x = start; x < start + size; ++x) bars[x].color = COLOR_SWAP;
+        ++flash_i;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+    updateTitle();
+}
+
+// Segments are handled in the recursion's post-order: a base segment is
+// sorted in one step, a merge writes one funnel output per step. Behind the
+// output come the elements waiting in the funnel's buffers (purple), then
+// what remains of each run in its own color.
+void SortingVisualizer::funnelSortStep() {
+    if (funnel_task == (int)funnel_tasks.size()) {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    } else if (!funnel_tree) {
+        int lo = funnel_tasks[funnel_task].first, n = funnel_tasks[funnel_task].second;
+        for (auto& bar : bars) bar.color = COLOR_BAR;
+        if (n <= FUNNEL_VIS_BASE) {
+            insertionSortRange(bars.data() + lo, n);
+            for (int k = lo; k < lo + n; ++k) bars[k].color = COLOR_SWAP;
+            ++funnel_task;
+        } else {
+            funnel_data.clear();
+            for (int k = lo; k < lo + n; ++k) funnel_data.push_back(bars[k].value);
+            std::vector<ArrayRun<int>> runs;
+            for (int s = 0, segment = funnelSegment(n); s < n; s += segment) {
+                runs.push_back({funnel_data.data() + s, funnel_data.data() + std::min(n, s + segment)});
+            }
+            funnel_tree.reset(new KFunnel<int>(runs, funnel_arena));
+            funnel_out = 0;
+            funnel_refilled.clear();
+        }
+    } else {
+        int lo = funnel_tasks[funnel_task].first, n = funnel_tasks[funnel_task].second;
+        std::vector<int> before;
+        for (int j = 1; j < funnel_tree->size(); ++j) before.push_back(funnel_tree->refills(j));
+        for (auto& bar : bars) bar.color = COLOR_BAR;
+        for (int k = lo; k < lo + funnel_out; ++k) bars[k].color = COLOR_SORTED;
+        bars[lo + funnel_out] = { funnel_tree->pop(), COLOR_SWAP };
+        ++funnel_out;
+        funnel_refilled.clear();
+        for (int j = 1; j < funnel_tree->size(); ++j) {
+            if (funnel_tree->refills(j) != before[j - 1]) funnel_refilled.push_back(j);
+        }
+        int k = lo + funnel_out;
+        for (int j = 1; j < funnel_tree->size(); ++j) {
+            for (int i = 0; i < funnel_tree->buffered(j); ++i) bars[k++] = { funnel_tree->buffer(j)[i], COLOR_BOUNDARY };
+        }
+        for (int i = 0; i < funnel_tree->size(); ++i) {
+            for (const int* x = funnel_tree->leaf(i).next; x != funnel_tree->leaf(i).end; ++x) {
+                bars[k++] = { *x, THREAD_COLORS[i % THREAD_COLOR_COUNT] };
+            }
+        }
+        if (funnel_out == n) {
+            funnel_tree.reset();
+            ++funnel_task;
+        }
+    }
+    updateTitle();
+}
+
+// The whole sort runs in one step; the title shows how long it took next to
+// its counted cost. Without parallel policies the par_unseq entry falls
+// back to the sequential std::sort.
+void SortingVisualizer::referenceSortStep() {
+    auto start = std::chrono::steady_clock::now();
+    if (!runSortKernel(currentSort, bars.data(), BAR_COUNT)) std::sort(bars.begin(), bars.end(), KeyLess());
+    reference_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    for (auto& bar : bars) bar.color = COLOR_SORTED;
+    sorted = true;
+    sorting = false;
+    updateTitle();
+}
+
+// One binary-search probe per step, with the remaining search range in
+// purple; once the range is empty the block above the insertion point moves
+// up in a single step.
+void SortingVisualizer::binaryInsertionSortStep() {
+    if (binary_i < BAR_COUNT) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = k >= binary_lo && k < binary_hi ? COLOR_BOUNDARY : COLOR_BAR;
+        if (binary_lo < binary_hi) {
+            binary_probe = binary_lo + (binary_hi - binary_lo) / 2;
+            if (bars[binary_i].value < bars[binary_probe].value) {
+                binary_hi = binary_probe;
+            } else {
+                binary_lo = binary_probe + 1;
+            }
+            bars[binary_probe].color = COLOR_COMPARE;
+            bars[binary_i].color = COLOR_SWAP;
+        } else {
+            Bar x = bars[binary_i];
+            std::move_backward(bars.begin() + binary_lo, bars.begin() + binary_i, bars.begin() + binary_i + 1);
+            bars[binary_lo] = x;
+            for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = k > binary_lo && k <= binary_i ? COLOR_COMPARE : COLOR_BAR;
+            bars[binary_lo].color = COLOR_SWAP;
+            binary_hi = ++binary_i;
+            binary_lo = 0;
+        }
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+void SortingVisualizer::selectionSortStep() {
+    if (selection_i < BAR_COUNT - 1) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+        selection_min = selection_i;
+        for (int j = selection_i + 1; j < BAR_COUNT; ++j) {
+            bars[j].color = COLOR_COMPARE;
+            if (bars[j].value < bars[selection_min].value) {
+                selection_min = j;
+            }
+        }
+        std::swap(bars[selection_i], bars[selection_min]);
+        bars[selection_i].color = COLOR_SWAP;
+        ++selection_i;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+void SortingVisualizer::insertionSortStep() {
+    if (insertion_i < BAR_COUNT) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+        int j = insertion_i;
+        while (j > 0 && bars[j - 1].value > bars[j].value) {
+            std::swap(bars[j], bars[j - 1]);
+            bars[j].color = COLOR_SWAP;
+            bars[j - 1].color = COLOR_SWAP;
+            --j;
+        }
+        bars[insertion_i].color = COLOR_COMPARE;
+        ++insertion_i;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+void SortingVisualizer::mergeSortStep() {
+    if (merge_size < BAR_COUNT) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+        int left = 0;
+        while (left < BAR_COUNT) {
+            int mid = std::min(left + merge_size - 1, BAR_COUNT - 1);
+            int right = std::min(left + 2 * merge_size - 1, BAR_COUNT - 1);
+            int n1 = mid - left + 1;
+            int n2 = right - mid;
+            std::vector<Bar> L(bars.begin() + left, bars.begin() + mid + 1);
+            std::vector<Bar> R(bars.begin() + mid + 1, bars.begin() + right + 1);
+            int i = 0, j = 0, k = left;
+            while (i < n1 && j < n2) {
+                bars[k].color = COLOR_COMPARE;
+                if (L[i].value <= R[j].value) {
+                    bars[k++] = L[i++];
+                } else {
+                    bars[k++] = R[j++];
+                }
+            }
+            while (i < n1) bars[k++] = L[i++];
+            while (j < n2) bars[k++] = R[j++];
+            left += 2 * merge_size;
+        }
+        merge_size *= 2;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One partition per step: the partitioned range in orange, its block of
+// keys equal to the pivot (already final) in purple.
+void SortingVisualizer::threeWayQuickSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (!three_way_stack.empty()) {
+        int l = three_way_stack.back().first, r = three_way_stack.back().second;
+        three_way_stack.pop_back();
+        if (l < r) {
+            medianOfThreeToEnd(bars.data(), l, r);
+            std::swap(bars[l], bars[r]);
+            three_way_equal = threeWayPartition(bars.data(), l, r);
+            for (int k = l; k <= r; ++k) bars[k].color = COLOR_COMPARE;
+            for (int k = three_way_equal.first; k <= three_way_equal.second; ++k) bars[k].color = COLOR_BOUNDARY;
+            three_way_stack.push_back({l, three_way_equal.first - 1});
+            three_way_stack.push_back({three_way_equal.second + 1, r});
+        }
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// The selection modes end with only their target green; the bars left in
+// the base color are the part they never sorted.
+void SortingVisualizer::introSelectStep() {
+    int k = selectionTarget(INTRO_SELECT, BAR_COUNT);
+    for (int i = 0; i < BAR_COUNT; ++i) bars[i].color = COLOR_BAR;
+    if (select_lo < select_hi) {
+        int l = select_lo, r = select_hi;
+        if (select_budget == 0) {
+            heapSelect(bars.data() + l, r - l + 1, k - l);
+            select_lo = select_hi = k;
+        } else {
+            --select_budget;
+            medianOfThreeToEnd(bars.data(), l, r);
+            std::swap(bars[l], bars[r]);
+            std::pair<int, int> equal = threeWayPartition(bars.data(), l, r);
+            for (int i = l; i <= r; ++i) bars[i].color = COLOR_COMPARE;
+            for (int i = equal.first; i <= equal.second; ++i) bars[i].color = COLOR_BOUNDARY;
+            if (k < equal.first) {
+                select_hi = equal.first - 1;
+            } else if (k > equal.second) {
+                select_lo = equal.second + 1;
+            } else {
+                select_lo = select_hi = k;
+            }
+        }
+        updateTitle();
+    } else {
+        bars[k].color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// The heap on a[0, k) is drawn in a worker color with its root in purple;
+// a scanned bar is orange when rejected and red when it replaces the root.
+void SortingVisualizer::heapTopKStep() {
+    int k = selectionTarget(HEAP_TOP_K, BAR_COUNT);
+    for (int i = 0; i < BAR_COUNT; ++i) bars[i].color = i < k ? THREAD_COLORS[0] : COLOR_BAR;
+    if (top_k_phase == 0) {
+        for (int i = k / 2 - 1; i >= 0; --i) siftDown(bars.data(), i, k);
+        top_k_phase = 1;
+    } else if (top_k_phase == 1) {
+        if (bars[top_k_i].value < bars[0].value) {
+            std::swap(bars[top_k_i], bars[0]);
+            siftDown(bars.data(), 0, k);
+            bars[top_k_i].color = COLOR_SWAP;
+        } else {
+            bars[top_k_i].color = COLOR_COMPARE;
+        }
+        if (++top_k_i == BAR_COUNT) {
+            top_k_phase = 2;
+            top_k_i = k - 1;
+        }
+    } else if (top_k_i > 0) {
+        std::swap(bars[0], bars[top_k_i]);
+        siftDown(bars.data(), 0, top_k_i--);
+        for (int i = top_k_i + 1; i < k; ++i) bars[i].color = COLOR_SORTED;
+    } else {
+        for (int i = 0; i < k; ++i) bars[i].color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+        return;
+    }
+    bars[0].color = top_k_phase < 2 || top_k_i > 0 ? COLOR_BOUNDARY : COLOR_SORTED;
+    updateTitle();
+}
+
+// Like the 3-Way Quick Sort view, but ranges at or past k are dropped
+// without being partitioned.
+void SortingVisualizer::partialQuickSortStep() {
+    int k = selectionTarget(PARTIAL_QUICK, BAR_COUNT);
+    for (int i = 0; i < BAR_COUNT; ++i) bars[i].color = COLOR_BAR;
+    while (!partial_stack.empty() && (partial_stack.back().first >= k || partial_stack.back().first >= partial_stack.back().second)) {
+        partial_stack.pop_back();
+    }
+    if (!partial_stack.empty()) {
+        int l = partial_stack.back().first, r = partial_stack.back().second;
+        partial_stack.pop_back();
+        medianOfThreeToEnd(bars.data(), l, r);
+        std::swap(bars[l], bars[r]);
+        std::pair<int, int> equal = threeWayPartition(bars.data(), l, r);
+        for (int i = l; i <= r; ++i) bars[i].color = COLOR_COMPARE;
+        for (int i = equal.first; i <= equal.second; ++i) bars[i].color = COLOR_BOUNDARY;
+        partial_stack.push_back({equal.second + 1, r});
+        partial_stack.push_back({l, equal.first - 1});
+        updateTitle();
+    } else {
+        for (int i = 0; i < k; ++i) bars[i].color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// The top level runs step by step: one pair compared per step (larger bars
+// moved right), then the larger halves sorted recursively in one step and
+// laid out as the chain b1 a1 ... ah, followed by the pending b's in a
+// worker color. Each insertion then shows one binary-search probe per step
+// over the part of the chain in front of its partner (purple).
+void SortingVisualizer::mergeInsertionSortStep() {
+    int half = BAR_COUNT / 2;
+    for (int i = 0; i < BAR_COUNT; ++i) bars[i].color = COLOR_BAR;
+    if (insertion_phase == 0) {
+        for (int i = 0; i < 2 * insertion_pair; ++i) bars[i].color = THREAD_COLORS[i % 2];
+        Bar& smaller = bars[2 * insertion_pair];
+        Bar& larger = bars[2 * insertion_pair + 1];
+        bool swap = larger.value < smaller.value;
+        if (swap) std::swap(smaller, larger);
+        smaller.color = larger.color = swap ? COLOR_SWAP : COLOR_COMPARE;
+        if (++insertion_pair == half) insertion_phase = 1;
+    } else if (insertion_phase == 1) {
+        std::vector<Bar> winners;
+        for (int p = 0; p < half; ++p) winners.push_back(bars[2 * p + 1]);
+        std::vector<int> items(half);
+        for (int p = 0; p < half; ++p) items[p] = p;
+        std::vector<int> order = mergeInsertionOrder(winners.data(), items);
+        std::vector<Bar> laid;
+        insertion_label.clear();
+        laid.push_back(bars[2 * order[0]]);
+        insertion_label.push_back(-1);
+        for (int j = 1; j <= half; ++j) {
+            laid.push_back(bars[2 * order[j - 1] + 1]);
+            insertion_label.push_back(j);
+        }
+        for (int j = 2; j <= half; ++j) {
+            laid.push_back(bars[2 * order[j - 1]]);
+            insertion_label.push_back(-j);
+        }
+        if (BAR_COUNT % 2) {
+            laid.push_back(bars[BAR_COUNT - 1]);
+            insertion_label.push_back(-(half + 1));
+        }
+        bars = laid;
+        insertion_chain = half + 1;
+        insertion_order = jacobsthalOrder(half + BAR_COUNT % 2);
+        insertion_phase = 2;
+        for (int i = insertion_chain; i < BAR_COUNT; ++i) bars[i].color = THREAD_COLORS[1];
+    } else if (insertion_next < (int)insertion_order.size()) {
+        int j = insertion_order[insertion_next];
+        auto labelAt = [&](int label) {
+            return (int)(std::find(insertion_label.begin(), insertion_label.end(), label) - insertion_label.begin());
+        };
+        int pos = labelAt(-j);
+        if (insertion_hi < 0) {
+            insertion_lo = 0;
+            insertion_hi = j <= half ? labelAt(j) : insertion_chain;
+        }
+        for (int i = insertion_chain; i < BAR_COUNT; ++i) bars[i].color = THREAD_COLORS[1];
+        if (insertion_lo < insertion_hi) {
+            for (int i = insertion_lo; i < insertion_hi; ++i) bars[i].color = COLOR_BOUNDARY;
+            int probe = insertion_lo + (insertion_hi - insertion_lo) / 2;
+            if (bars[pos].value < bars[probe].value) {
+                insertion_hi = probe;
+            } else {
+                insertion_lo = probe + 1;
+            }
+            bars[probe].color = COLOR_COMPARE;
+            bars[pos].color = COLOR_SWAP;
+        } else {
+            std::rotate(bars.begin() + insertion_lo, bars.begin() + pos, bars.begin() + pos + 1);
+            std::rotate(insertion_label.begin() + insertion_lo, insertion_label.begin() + pos, insertion_label.begin() + pos + 1);
+            bars[insertion_lo].color = COLOR_SWAP;
+            ++insertion_chain;
+            ++insertion_next;
+            insertion_hi = -1;
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+        return;
+    }
+    updateTitle();
+}
+
+void SortingVisualizer::quickSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (!quick_stack.empty()) {
+        auto& top = quick_stack.back();
+        int l = top.first, r = top.second;
+        if (l < r) {
+            int pivot = bars[r].value;
+            int i = l - 1;
+            for (int j = l; j < r; ++j) {
+                bars[j].color = COLOR_COMPARE;
+                if (bars[j].value < pivot) {
+                    ++i;
+                    std::swap(bars[i], bars[j]);
+                    bars[i].color = COLOR_SWAP;
+                    bars[j].color = COLOR_SWAP;
+                }
+            }
+            std::swap(bars[i + 1], bars[r]);
+            bars[i + 1].color = COLOR_SWAP;
+            quick_stack.pop_back();
+            quick_stack.push_back({l, i});
+            quick_stack.push_back({i + 2, r});
+        } else {
+            quick_stack.pop_back();
+        }
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+void SortingVisualizer::americanFlagSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (!flag_stack.empty()) {
+        RadixRange range = flag_stack.back();
+        flag_stack.pop_back();
+        int n = range.r - range.l;
+        if (n <= FLAG_VIS_INSERTION_CUTOFF) {
+            insertionSortRange(&bars[range.l], n);
+            for (int k = range.l; k < range.r; ++k) bars[k].color = COLOR_SWAP;
+        } else {
+            const int buckets = 1 << FLAG_VIS_RADIX_BITS;
+            int ends[FLAG_MAX_BUCKETS];
+            americanFlagPass(&bars[range.l], n, range.shift, FLAG_VIS_RADIX_BITS, ends);
+            for (int k = range.l; k < range.r; ++k) bars[k].color = COLOR_COMPARE;
+            for (int d = buckets - 1, end = n; d >= 0; --d) {
+                int begin = d > 0 ? ends[d - 1] : 0;
+                if (end > begin) bars[range.l + begin].color = COLOR_BOUNDARY;
+                if (end - begin > 1 && range.shift > 0) {
+                    flag_stack.push_back({range.l + begin, range.l + end, range.shift - FLAG_VIS_RADIX_BITS});
+                }
+                end = begin;
+            }
+        }
+        // Bucket tables of one pass plus the pending-range stack; no O(N) buffer.
+        size_t aux = 2 * (1 << FLAG_VIS_RADIX_BITS) * sizeof(int) + flag_stack.size() * sizeof(RadixRange);
+        flag_peak_aux = std::max(flag_peak_aux, aux);
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One step is a whole network stage: all of its compare-exchanges are
+// independent, so they light up together.
+void SortingVisualizer::bitonicSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (bitonic_k <= nextPowerOfTwo(BAR_COUNT)) {
+        for (int i = 0; i < BAR_COUNT; ++i) {
+            int p = bitonicPartner(i, bitonic_k, bitonic_j);
+            if (p <= i || p >= BAR_COUNT) continue;
+            bars[i].color = COLOR_COMPARE;
+            bars[p].color = COLOR_COMPARE;
+            if (bars[p].value < bars[i].value) {
+                std::swap(bars[i], bars[p]);
+                bars[i].color = COLOR_SWAP;
+                bars[p].color = COLOR_SWAP;
+            }
+        }
+        ++bitonic_stage;
+        if ((bitonic_j /= 2) == 0) {
+            bitonic_k *= 2;
+            bitonic_j = bitonic_k / 2;
+        }
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One step is one phase; each worker's share of the pairs is drawn in its
+// own color, with swapped pairs in red.
+void SortingVisualizer::oddEvenSortStep() {
+    if (odd_even_phase < BAR_COUNT) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+        int first = odd_even_phase & 1;
+        int pairs = (BAR_COUNT - first) / 2;
+        for (int t = 0; t < VIS_THREAD_COUNT; ++t) {
+            for (int q = chunkBegin(pairs, t, VIS_THREAD_COUNT); q < chunkBegin(pairs, t + 1, VIS_THREAD_COUNT); ++q) {
+                int i = first + 2 * q;
+                bars[i].color = bars[i + 1].color = THREAD_COLORS[t % THREAD_COLOR_COUNT];
+                if (bars[i].value > bars[i + 1].value) {
+                    std::swap(bars[i], bars[i + 1]);
+                    bars[i].color = bars[i + 1].color = COLOR_SWAP;
+                }
+            }
+        }
+        ++odd_even_phase;
+        updateTitle();
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One step merges every pair of runs of the current width as tasks on a real
+// pool. When there are fewer merges than workers each merge is split by merge
+// path. Every bar takes the color of the worker that last wrote it.
+void SortingVisualizer::parallelMergeSortStep() {
+    if (pmerge_width < BAR_COUNT) {
+        if (!pool) pool.reset(new WorkStealingPool(VIS_THREAD_COUNT));
+        std::vector<Bar> src(bars);
+        int width = pmerge_width;
+        int merges = (BAR_COUNT + 2 * width - 1) / (2 * width);
+        int parts = std::max(1, VIS_THREAD_COUNT / merges);
+        TaskGroup group;
+        for (int left = 0; left < BAR_COUNT; left += 2 * width) {
+            int mid = std::min(left + width, BAR_COUNT), right = std::min(left + 2 * width, BAR_COUNT);
+            for (int p = 0; p < parts; ++p) {
+                pool->spawn(group, [this, &src, left, mid, right, p, parts] {
+                    mergePathSegment(&src[left], mid - left, &src[mid], right - mid, &bars[left], p, parts);
+                    SDL_Color c = THREAD_COLORS[WorkStealingPool::currentWorker() % THREAD_COLOR_COUNT];
+                    for (int k = left + chunkBegin(right - left, p, parts); k < left + chunkBegin(right - left, p + 1, parts); ++k) {
+                        bars[k].color = c;
+                    }
+                });
+            }
+        }
+        pool->wait(group);
+        pmerge_width *= 2;
+        updateTitle();
+    } else {
+        pool.reset();
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// Steps: pick splitters from a random sample, classify (bars take their
+// bucket's color), scatter into bucket order, then sort one bucket per step.
+// Uses one bucket per visualized worker.
+void SortingVisualizer::sampleSortStep() {
+    const int buckets = VIS_THREAD_COUNT;
+    if (sample_phase == 0) {
+        for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+        std::random_device rd;
+        std::mt19937 g(rd());
+        std::vector<int> sampled;
+        sample_splitters = sampleSortSplitters(bars.data(), BAR_COUNT, buckets, 4, g, &sampled);
+        for (int i : sampled) bars[i].color = COLOR_COMPARE;
+        for (auto& bar : bars) {
+            if (std::binary_search(sample_splitters.begin(), sample_splitters.end(), bar.value)) bar.color = COLOR_BOUNDARY;
+        }
+    } else if (sample_phase == 1) {
+        for (auto& bar : bars) bar.color = THREAD_COLORS[sampleSortBucket(sample_splitters, bar.value) % THREAD_COLOR_COUNT];
+    } else if (sample_phase == 2) {
+        std::stable_sort(bars.begin(), bars.end(), [this](const Bar& x, const Bar& y) {
+            return sampleSortBucket(sample_splitters, x.value) < sampleSortBucket(sample_splitters, y.value);
+        });
+        sample_bucket_start.assign(buckets + 1, BAR_COUNT);
+        for (int k = BAR_COUNT - 1; k >= 0; --k) sample_bucket_start[sampleSortBucket(sample_splitters, bars[k].value)] = k;
+        for (int b = buckets - 1; b >= 0; --b) sample_bucket_start[b] = std::min(sample_bucket_start[b], sample_bucket_start[b + 1]);
+    } else if (sample_phase - 3 < buckets) {
+        int b = sample_phase - 3;
+        for (int k = 0; k < BAR_COUNT; ++k) {
+            bars[k].color = THREAD_COLORS[sampleSortBucket(sample_splitters, bars[k].value) % THREAD_COLOR_COUNT];
+        }
+        bottomUpMergeSort(&bars[sample_bucket_start[b]], sample_bucket_start[b + 1] - sample_bucket_start[b]);
+        for (int k = sample_bucket_start[b]; k < sample_bucket_start[b + 1]; ++k) bars[k].color = COLOR_SWAP;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+        return;
+    }
+    updateTitle();
+    ++sample_phase;
+}
+
+// One step is one block partition. Bars the partition moved are red, the
+// rest of the range orange, the pivot purple.
+void SortingVisualizer::blockQuickSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (!block_quick_stack.empty()) {
+        int l = block_quick_stack.back().first, r = block_quick_stack.back().second;
+        block_quick_stack.pop_back();
+        if (l < r) {
+            medianOfThreeToEnd(bars.data(), l, r);
+            std::vector<Bar> before(bars.begin() + l, bars.begin() + r + 1);
+            int p = blockPartition(bars.data(), l, r, BLOCKQS_VIS_BLOCK);
+            for (int k = l; k <= r; ++k) bars[k].color = bars[k].value == before[k - l].value ? COLOR_COMPARE : COLOR_SWAP;
+            bars[p].color = COLOR_BOUNDARY;
+            block_quick_stack.push_back({p + 1, r});
+            block_quick_stack.push_back({l, p - 1});
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// Same as Block Quick Sort, but each partition runs the vector kernel on the
+// range's keys and writes them back (a bar is fully described by its value).
+void SortingVisualizer::simdQuickSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = COLOR_BAR;
+    if (!simd_quick_stack.empty()) {
+        int l = simd_quick_stack.back().first, r = simd_quick_stack.back().second;
+        simd_quick_stack.pop_back();
+        if (l < r) {
+            medianOfThreeToEnd(bars.data(), l, r);
+            std::vector<int> keys(r - l + 1);
+            for (int k = l; k <= r; ++k) keys[k - l] = bars[k].value;
+            int p = l + simdPartition(keys.data(), 0, r - l, detectSimdLevel());
+            for (int k = l; k <= r; ++k) {
+                bars[k].color = bars[k].value == keys[k - l] ? COLOR_COMPARE : COLOR_SWAP;
+                bars[k].value = keys[k - l];
+            }
+            bars[p].color = COLOR_BOUNDARY;
+            simd_quick_stack.push_back({p + 1, r});
+            simd_quick_stack.push_back({l, p - 1});
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// One step places one cycle. Bars written this step are red, the range
+// scanned to find their positions orange.
+void SortingVisualizer::cycleSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = k < cycle_start ? COLOR_SORTED : COLOR_BAR;
+    if (cycle_start < BAR_COUNT - 1) {
+        std::vector<int> before;
+        for (const auto& bar : bars) before.push_back(bar.value);
+        cycleSortCycle(bars.data(), BAR_COUNT, cycle_start);
+        for (int k = cycle_start; k < BAR_COUNT; ++k) bars[k].color = bars[k].value == before[k] ? COLOR_COMPARE : COLOR_SWAP;
+        ++cycle_start;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// Fills the histogram a few bars per step, then drains it back into the bars
+// in key order; a bar is just its value, so writing values is the output.
+void SortingVisualizer::countingSortStep() {
+    for (int k = 0; k < BAR_COUNT; ++k) bars[k].color = counting_phase == 1 && k < counting_pos ? COLOR_SORTED : COLOR_BAR;
+    if (counting_phase == 0) {
+        for (int i = 0; i < COUNTING_VIS_CHUNK && counting_pos < BAR_COUNT; ++i, ++counting_pos) {
+            ++counting_hist[bars[counting_pos].value - counting_min];
+            bars[counting_pos].color = COLOR_COMPARE;
+        }
+        if (counting_pos == BAR_COUNT) {
+            counting_phase = 1;
+            counting_pos = counting_key = 0;
+            updateTitle();
+        }
+    } else if (counting_pos < BAR_COUNT) {
+        for (int i = 0; i < COUNTING_VIS_CHUNK && counting_pos < BAR_COUNT; ++i, ++counting_pos) {
+            while (counting_hist[counting_key] == 0) ++counting_key;
+            --counting_hist[counting_key];
+            bars[counting_pos].value = counting_min + counting_key;
+            bars[counting_pos].color = COLOR_SWAP;
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+}
+
+// Key collection, then one insertion-sorted run or one merged pair per step,
+// then the keys are merged back. Tags are purple and the buffer, wherever it
+// has travelled to, is drawn in a worker color.
+void SortingVisualizer::blockMergeSortStep() {
+    for (auto& bar : bars) bar.color = COLOR_BAR;
+    const BlockMergeLayout& layout = block_layout;
+    if (block_phase == 0) {
+        block_layout = blockMergeSetup(bars.data(), BAR_COUNT);
+        block_phase = 1;
+        block_lo = layout.data;
+        block_buffer_at = layout.data - layout.buffer;
+        updateTitle();
+    } else if (block_phase == 1) {
+        int len = std::min(layout.firstRun, BAR_COUNT - block_lo);
+        insertionSortRange(bars.data() + block_lo, len);
+        for (int k = block_lo; k < block_lo + len; ++k) bars[k].color = COLOR_SWAP;
+        block_lo += layout.firstRun;
+        if (block_lo >= BAR_COUNT) {
+            block_phase = 2;
+            block_run = layout.firstRun;
+            block_lo = layout.data;
+            updateTitle();
+        }
+    } else if (block_phase == 2 && block_run < BAR_COUNT - layout.data) {
+        if (block_lo + block_run < BAR_COUNT) {
+            block_buffer_at = blockMergeStep(bars.data(), BAR_COUNT, layout, block_lo, block_run);
+            for (int k = block_lo - layout.buffer; k < std::min(BAR_COUNT, block_lo + 2 * block_run); ++k) bars[k].color = COLOR_SWAP;
+            block_lo += 2 * block_run;
+        } else {
+            blockMergeRewind(bars.data(), layout, block_buffer_at);
+            block_buffer_at = layout.data - layout.buffer;
+            block_run *= 2;
+            block_lo = layout.data;
+            updateTitle();
+        }
+    } else if (block_phase == 2) {
+        blockMergeFinish(bars.data(), BAR_COUNT, layout);
+        block_phase = 3;
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+        return;
+    }
+    if (block_phase < 3) {
+        if (layout.tagged) {
+            for (int k = 0; k < layout.buffer; ++k) bars[k].color = COLOR_BOUNDARY;
+        }
+        for (int k = block_buffer_at; k < block_buffer_at + layout.buffer; ++k) bars[k].color = THREAD_COLORS[1];
+    } else {
+        for (int k = 0; k < layout.keys; ++k) bars[k].color = COLOR_SWAP;
+    }
+}
+
+// Draws the loser tree in the strip above the bars: the winner on top, then
+// each level of internal nodes in the color of the run holding that loss.
+// Matches replayed by the last step are drawn in the compare color.
+void SortingVisualizer::drawLoserTree() {
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    for (int j = 0; j < external_tree->size(); ++j) {
+        int depth = 0;
+        while ((2 << depth) <= j) ++depth;
+        int level = j == 0 ? 0 : depth + 1;
+        int slots = j == 0 ? 1 : 1 << depth;
+        int slot = j == 0 ? 0 : j - (1 << depth);
+        bool replayed = std::find(external_replay.begin(), external_replay.end(), j) != external_replay.end();
+        SDL_Color color = replayed ? COLOR_COMPARE : THREAD_COLORS[external_tree->at(j) % THREAD_COLOR_COUNT];
+        SDL_Rect rect = { (2 * slot + 1) * w / (2 * slots) - 5, 2 + level * 9, 10, 7 };
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+        SDL_RenderFillRect(renderer, &rect);
+    }
+}
+
+// Run generation sorts one budget-sized chunk per step and "spills" it (a
+// copy stands in for the temporary file); the loser tree then writes one
+// element per step. Bars left of the output position are the merged output,
+// the rest is what remains of each run, in its run's color, with the heads
+// of the runs whose stored losses were just replayed highlighted.
+void SortingVisualizer::externalSortStep() {
+    if (external_phase == 0) {
+        int len = std::min(EXTERNAL_VIS_CHUNK, BAR_COUNT - external_lo);
+        bottomUpMergeSort(bars.data() + external_lo, len);
+        std::vector<int> run;
+        for (int k = external_lo; k < external_lo + len; ++k) {
+            bars[k].color = THREAD_COLORS[external_runs.size() % THREAD_COLOR_COUNT];
+            run.push_back(bars[k].value);
+        }
+        external_runs.push_back(run);
+        external_lo += len;
+        if (external_lo == BAR_COUNT) {
+            external_phase = 1;
+            for (const auto& run : external_runs) external_sources.push_back({run.data(), run.data() + run.size()});
+            external_tree.reset(new LoserTree<ArrayRun<int>>(external_sources));
+        }
+    } else if (external_out < BAR_COUNT) {
+        external_replay.clear();
+        std::vector<int> compared;
+        for (int j = external_tree->leafParent(external_tree->at(0)); j >= 1; j /= 2) {
+            external_replay.push_back(j);
+            compared.push_back(external_tree->at(j));
+        }
+        for (int k = 0; k < external_out; ++k) bars[k].color = COLOR_SORTED;
+        bars[external_out++] = { external_tree->pop(), COLOR_SWAP };
+        int k = external_out;
+        for (int r = 0; r < (int)external_sources.size(); ++r) {
+            bool replayed = std::find(compared.begin(), compared.end(), r) != compared.end();
+            for (const int* x = external_sources[r].next; x != external_sources[r].end; ++x) {
+                bool head = x == external_sources[r].next;
+                bars[k++] = { *x, head && replayed ? COLOR_COMPARE : THREAD_COLORS[r % THREAD_COLOR_COUNT] };
+            }
+        }
+    } else {
+        for (auto& bar : bars) bar.color = COLOR_SORTED;
+        sorted = true;
+        sorting = false;
+    }
+    updateTitle();
+}
+
+void SortingVisualizer::run() {
+    while (true) {
+        handleEvents();
+        if (sorting && !paused && !sorted) {
+            sortStep();
+            drawBars();
+            SDL_Delay(speed);
+        } else {
+            drawBars();
+            SDL_Delay(10);
+        }
+    }
+}
+
+// Benchmark mode
+// `SortingVisualizer --bench [suite]` times the plain kernels on large random
+// arrays and prints a table instead of opening a window.
+
+typedef void (*SortFn)(std::vector<int>&);
+
+struct BenchEntry {
+    const char* name;
+    SortFn sort;
+};
+
+// A timed kernel next to its Counted instantiation, for suites that report
+// operation counts as well as times.
+struct CountedBenchEntry {
+    const char* name;
+    SortFn sort;
+    void (*counted)(Counted*, int);
+};
+
+struct BenchInput {
+    const char* name;
+    std::vector<int> keys;
+};
+
+std::vector<int> randomInts(int n, unsigned seed) {
+    std::mt19937 g(seed);
+    std::uniform_int_distribution<int> dist(0, 1 << 30);
+    std::vector<int> v(n);
+    for (auto& x : v) x = dist(g);
+    return v;
+}
+
+// 0..n-1 in order with `swaps` random pairs up to `distance` apart exchanged.
+std::vector<int> nearlySortedInts(int n, int swaps, int distance, unsigned seed) {
+    std::mt19937 g(seed);
+    std::vector<int> v(n);
+    for (int i = 0; i < n; ++i) v[i] = i;
+    for (int s = 0; s < swaps; ++s) {
+        int i = (int)(g() % n);
+        int j = std::min(n - 1, i + 1 + (int)(g() % distance));
+        std::swap(v[i], v[j]);
+    }
+    return v;
+}
+
+// Sorted, locally perturbed, sparsely far-swapped, reversed and random keys.
+std::vector<BenchInput> presortedInputs(int n) {
+    std::vector<int> reversed = nearlySortedInts(n, 0, 1, 1);
+    std::reverse(reversed.begin(), reversed.end());
+    return {
+        {"sorted", nearlySortedInts(n, 0, 1, 1)},
+        {"1% swaps up to 8 apart", nearlySortedInts(n, n / 100, 8, 2)},
+        {"0.1% swaps anywhere", nearlySortedInts(n, n / 1000, n, 3)},
+        {"reversed", reversed},
+        {"random", randomInts(n, 4)},
+    };
+}
+
+// Keys drawn uniformly from [0, bound).
+std::vector<int> randomIntsBelow(int n, int bound, unsigned seed) {
+    std::mt19937 g(seed);
+    std::uniform_int_distribution<int> dist(0, bound - 1);
+    std::vector<int> v(n);
+    for (auto& x : v) x = dist(g);
+    return v;
+}
+
+// Best of `reps` runs, each on a fresh copy of `input`. Returns -1 if the
+// result is not sorted.
+template <typename F>
+double timeSortMs(F sort, const std::vector<int>& input, int reps = 3) {
+    double best = 1e300;
+    for (int r = 0; r < reps; ++r) {
+        std::vector<int> v = input;
+        auto start = std::chrono::steady_clock::now();
+        sort(v);
+        auto stop = std::chrono::steady_clock::now();
+        if (!std::is_sorted(v.begin(), v.end())) return -1;
+        best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    return best;
+}
+
+enum CounterEvent { EVENT_BRANCH_MISSES, EVENT_CACHE_MISSES };
+
+// Hardware event counter for the calling thread via perf_event_open. Where
+// that is unavailable (not Linux, no PMU, perf_event_paranoid) available()
+// is false and stop() returns -1.
+class PerfCounter {
+public:
+    explicit PerfCounter(CounterEvent event) : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = event == EVENT_BRANCH_MISSES ? PERF_COUNT_HW_BRANCH_MISSES : PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void)event;
+#endif
+    }
+    ~PerfCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+    bool available() const { return fd >= 0; }
+    void start() {
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    long long stop() {
+#ifdef __linux__
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) return -1;
+        return count;
+#else
+        return -1;
+#endif
+    }
+
+private:
+    int fd;
+};
+
+// Counts `event` over one run of `sort` on a copy of `input`; -1 if unavailable.
+template <typename F>
+long long countSortEvents(F sort, const std::vector<int>& input, CounterEvent event) {
+    PerfCounter counter(event);
+    std::vector<int> v = input;
+    counter.start();
+    sort(v);
+    return counter.stop();
+}
+
+#ifdef __linux__
+// A "Field:   123 kB" line of /proc/self/status in kB, or -1.
+long long procStatusKb(const char* field) {
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long long kb = -1;
+    size_t len = std::strlen(field);
+    while (std::fgets(line, sizeof(line), f)) {
+        if (std::strncmp(line, field, len) == 0 && line[len] == ':') {
+            kb = std::atoll(line + len + 1);
+            break;
+        }
+    }
+    std::fclose(f);
+    return kb;
+}
+#endif
+
+// How far the resident set's high-water mark rises while `sort` runs on a
+// copy of `input`, in bytes: the peak extra memory at page granularity.
+// -1 where the mark cannot be reset (Linux clear_refs only).
+template <typename F>
+long long peakExtraMemory(F sort, const std::vector<int>& input) {
+#ifdef __linux__
+    std::vector<int> v = input;
+    FILE* f = std::fopen("/proc/self/clear_refs", "w");
+    if (!f) return -1;
+    bool reset = std::fputs("5", f) >= 0;
+    if (std::fclose(f) != 0 || !reset) return -1;
+    long long before = procStatusKb("VmHWM");
+    sort(v);
+    long long peak = procStatusKb("VmHWM");
+    if (before < 0 || peak < 0) return -1;
+    return (peak - before) * 1024;
+#else
+    (void)sort;
+    (void)input;
+    return -1;
+#endif
+}
+
+// std::sort time on `input`, for the baseline column. Suites print several
+// rows per input, so the last input and its time are kept.
+double stdSortBaselineMs(const std::vector<int>& input) {
+    static std::vector<int> last;
+    static double ms = -1;
+    if (ms < 0 || input != last) {
+        last = input;
+        ms = timeSortMs([](std::vector<int>& v) { runSortKernel(STD_SORT, v.data(), (int)v.size()); }, input);
+    }
+    return ms;
+}
+
+// With a baseline time the row ends in the time relative to std::sort.
+void printBenchRow(const char* name, int n, double ms, double baselineMs = -1) {
+    if (ms < 0) {
+        printf("  %-28s %10d  %10s\n", name, n, "FAILED");
+    } else if (baselineMs > 0) {
+        printf("  %-28s %10d  %10.2f ms  %8.1f Melem/s  %7.2fx std::sort\n", name, n, ms, n / ms / 1000.0, ms / baselineMs);
+    } else {
+        printf("  %-28s %10d  %10.2f ms  %8.1f Melem/s\n", name, n, ms, n / ms / 1000.0);
+    }
+}
+
+// 1, 2, 4, ... up to and including the hardware thread count.
+std::vector<int> benchThreadCounts() {
+    std::vector<int> counts;
+    for (int t = 1; t < hardwareThreads(); t *= 2) counts.push_back(t);
+    counts.push_back(hardwareThreads());
+    return counts;
+}
+
+void printScalingRow(const char* name, int n, int threads, double ms, double baseMs, double baselineMs = -1) {
+    if (ms < 0) {
+        printf("  %-28s %10d  %2d threads  %10s\n", name, n, threads, "FAILED");
+    } else if (baselineMs > 0) {
+        printf("  %-28s %10d  %2d threads  %10.2f ms  speedup %5.2fx  %7.2fx std::sort\n", name, n, threads, ms, baseMs / ms,
+               ms / baselineMs);
+    } else {
+        printf("  %-28s %10d  %2d threads  %10.2f ms  speedup %5.2fx\n", name, n, threads, ms, baseMs / ms);
+    }
+}
+
+void benchNetwork() {
+    printf("Bitonic network (best ISA: %s) vs branchy sorts, random keys\n", SIMD_NAMES[detectSimdLevel()]);
+    const BenchEntry entries[] = {
+        {"Bitonic Sort (best ISA)", [](std::vector<int>& v) { bitonicSortInts(v.data(), (int)v.size(), detectSimdLevel()); }},
+        {"Bitonic Sort (scalar)", [](std::vector<int>& v) { bitonicSortInts(v.data(), (int)v.size(), SIMD_SCALAR); }},
+        {"Quick Sort (Lomuto)", [](std::vector<int>& v) { lomutoQuickSort(v.data(), (int)v.size()); }},
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+    };
+    for (int n : {1 << 16, 1000000, 1 << 22}) {
+        std::vector<int> input = randomInts(n, n);
+        for (const auto& e : entries) printBenchRow(e.name, n, timeSortMs(e.sort, input), stdSortBaselineMs(input));
+    }
+}
+
+// Odd-even transposition is O(n^2), so the sizes stay small; the point is
+// how the per-phase barrier limits scaling.
+void benchOddEven() {
+    printf("Odd-even transposition sort, scaling over worker threads (%d hardware threads)\n", hardwareThreads());
+    for (int n : {4000, 16000}) {
+        std::vector<int> input = randomInts(n, n);
+        double base = 0;
+        for (int threads : benchThreadCounts()) {
+            double ms = timeSortMs([&](std::vector<int>& v) { oddEvenTranspositionSort(v.data(), (int)v.size(), threads); }, input, 1);
+            if (threads == 1) base = ms;
+            printScalingRow("Odd-Even Transposition", n, threads, ms, base, stdSortBaselineMs(input));
+        }
+    }
+}
+
+void benchParallelMerge() {
+    printf("Parallel merge sort on a work-stealing pool, speedup vs 1 worker (%d hardware threads)\n", hardwareThreads());
+    for (int n : {1 << 20, 1 << 23}) {
+        std::vector<int> input = randomInts(n, n);
+        printBenchRow("Merge Sort (bottom-up)", n, timeSortMs([](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }, input), stdSortBaselineMs(input));
+        double base = 0;
+        for (int threads : benchThreadCounts()) {
+            WorkStealingPool pool(threads);
+            double ms = timeSortMs([&](std::vector<int>& v) { parallelMergeSort(v.data(), (int)v.size(), pool); }, input);
+            if (threads == 1) base = ms;
+            printScalingRow("Parallel Merge Sort", n, threads, ms, base, stdSortBaselineMs(input));
+        }
+    }
+}
+
+void benchSampleSort() {
+    printf("Parallel sample sort vs parallel merge sort (%d hardware threads)\n", hardwareThreads());
+    for (int n : {1 << 22, 1 << 25}) {
+        std::vector<int> input = randomInts(n, n);
+        for (int threads : benchThreadCounts()) {
+            WorkStealingPool pool(threads);
+            double sample = timeSortMs([&](std::vector<int>& v) { parallelSampleSort(v.data(), (int)v.size(), pool); }, input, 1);
+            double merge = timeSortMs([&](std::vector<int>& v) { parallelMergeSort(v.data(), (int)v.size(), pool); }, input, 1);
+            printScalingRow("Parallel Sample Sort", n, threads, sample, merge, stdSortBaselineMs(input));
+            printScalingRow("Parallel Merge Sort", n, threads, merge, merge, stdSortBaselineMs(input));
+        }
+    }
+}
+
+// Same driver (median-of-three, insertion cutoff) for both, so only the
+// partition loop differs.
+void benchBlockQuick() {
+    printf("Lomuto vs block partitioning, random keys\n");
+    const BenchEntry entries[] = {
+        {"Quick Sort (Lomuto)", [](std::vector<int>& v) { quickSortWith(v.data(), (int)v.size(), lomutoPartition<int>); }},
+        {"Block Quick Sort", [](std::vector<int>& v) { blockQuickSort(v.data(), (int)v.size()); }},
+    };
+    for (int n : {1 << 20, 1 << 23}) {
+        std::vector<int> input = randomInts(n, n);
+        for (const auto& e : entries) {
+            double ms = timeSortMs(e.sort, input);
+            long long misses = countSortEvents(e.sort, input, EVENT_BRANCH_MISSES);
+            printBenchRow(e.name, n, ms, stdSortBaselineMs(input));
+            if (misses >= 0) {
+                printf("  %-28s %10s  %10.1f M branch misses  %6.2f per element\n", "", "", misses / 1e6, (double)misses / n);
+            } else {
+                printf("  %-28s %10s  branch misses n/a (perf events unavailable)\n", "", "");
+            }
+        }
+    }
+}
+
+// Partition throughput of one full-array partition around a random pivot,
+// then whole-sort time, for every ISA level this CPU supports.
+void benchSimdPartition() {
+    printf("Vectorized partition per ISA level (best here: %s)\n", SIMD_NAMES[detectSimdLevel()]);
+    for (int n : {1 << 20, 1 << 24}) {
+        std::vector<int> input = randomInts(n, n);
+        for (int level = SIMD_SCALAR; level <= detectSimdLevel(); ++level) {
+            double best = 1e300;
+            for (int rep = 0; rep < 3; ++rep) {
+                std::vector<int> v = input;
+                auto start = std::chrono::steady_clock::now();
+                simdPartition(v.data(), 0, n - 1, (SimdLevel)level);
+                auto stop = std::chrono::steady_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+            }
+            double ms = timeSortMs([level](std::vector<int>& v) { simdQuickSort(v.data(), (int)v.size(), (SimdLevel)level); }, input);
+            printf("  %-10s %10d  partition %6.2f elem/ns   sort %10.2f ms  %7.2fx std::sort\n", SIMD_NAMES[level], n, n / best, ms,
+                   ms / stdSortBaselineMs(input));
+        }
+    }
+}
+
+// Merging two sorted halves of random keys, scalar loop vs vector kernel;
+// then whole merge sorts, whose int merges now use the best kernel.
+void benchSimdMerge() {
+    printf("Merge kernel throughput (best here: %s)\n", SIMD_NAMES[std::min(detectSimdLevel(), SIMD_AVX2)]);
+    for (int n : {1 << 16, 1 << 22}) {
+        std::vector<int> input = randomInts(n, n), out(n);
+        std::sort(input.begin(), input.begin() + n / 2);
+        std::sort(input.begin() + n / 2, input.end());
+        for (int level = SIMD_SCALAR; level <= std::min(detectSimdLevel(), SIMD_AVX2); ++level) {
+            double best = 1e300;
+            for (int rep = 0; rep < 5; ++rep) {
+                auto start = std::chrono::steady_clock::now();
+                mergeIntsSimd(input.data(), n / 2, input.data() + n / 2, n - n / 2, out.data(), (SimdLevel)level);
+                auto stop = std::chrono::steady_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::milli>(stop - start).count());
+            }
+            bool ok = std::is_sorted(out.begin(), out.end());
+            printf("  merge %-22s %10d  %10.3f ms  %8.1f Melem/s%s\n", SIMD_NAMES[level], n, best, n / best / 1000.0, ok ? "" : "  FAILED");
+        }
+        std::vector<int> shuffled = randomInts(n, n);
+        printBenchRow("Merge Sort (bottom-up)", n, timeSortMs([](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }, shuffled), stdSortBaselineMs(shuffled));
+    }
+}
+
+// Base case (insertion sort vs sorting network) and cutoff size for the
+// block quick sort and a bottom-up merge sort that starts from sorted runs.
+void benchNetworkCutoffs() {
+    const int n = 1 << 22;
+    std::vector<int> input = randomInts(n, n);
+    printf("Small-range base cases, %d random keys (ms; std::sort %.2f ms)\n", n, stdSortBaselineMs(input));
+    printf("  %6s  %14s  %14s  %14s  %14s\n", "cutoff", "quick+insert", "quick+network", "merge+insert", "merge+network");
+    for (int cutoff : {2, 4, 8, 12, 16, 20, 24, 32}) {
+        auto insertion = [](int* x, int m) { insertionSortRange(x, m); };
+        auto network = [](int* x, int m) { networkSort(x, m); };
+        auto block = [](int* x, int l, int r) { return blockPartition(x, l, r); };
+        double qi = timeSortMs([&](std::vector<int>& v) { quickSortWith(v.data(), n, block, cutoff, insertion); }, input);
+        double qn = timeSortMs([&](std::vector<int>& v) { quickSortWith(v.data(), n, block, cutoff, network); }, input);
+        double mi = timeSortMs([&](std::vector<int>& v) {
+            for (int left = 0; left < n; left += cutoff) insertionSortRange(v.data() + left, std::min(cutoff, n - left));
+            mergeSortedRuns(v.data(), n, cutoff);
+        }, input);
+        double mn = timeSortMs([&](std::vector<int>& v) { bottomUpMergeSort(v.data(), n, cutoff); }, input);
+        printf("  %6d  %14.2f  %14.2f  %14.2f  %14.2f\n", cutoff, qi, qn, mi, mn);
+    }
+}
+
+// Reads, writes and comparisons of every algorithm on the same input, and
+// their weighted cost under each preset model (plus --cost=R,W,C if given).
+void benchCost() {
+    const int n = 2000;
+    std::vector<int> input = randomInts(n, n);
+    bool custom = std::strcmp(activeCostModel.name, "custom") == 0;
+    printf("Operation counts on %d random keys; writes count only the sorted array\n", n);
+    printf("  %-28s %10s %10s %10s", "algorithm", "reads", "writes", "compares");
+    for (const auto& model : COST_MODELS) printf(" %16s", model.name);
+    if (custom) printf(" %16s", "custom");
+    printf(" %14s\n", "vs std::sort");
+    OpCounts baseline;
+    measureSortCost(STD_SORT, input, baseline);
+    for (int type = 0; type < SORT_COUNT; ++type) {
+        OpCounts ops;
+        if (!measureSortCost((SortType)type, input, ops)) {
+            printf("  %-28s %10s\n", SORT_NAMES[type], "n/a");
+            continue;
+        }
+        printf("  %-28s %10lld %10lld %10lld", SORT_NAMES[type], ops.reads, ops.writes, ops.compares);
+        for (const auto& model : COST_MODELS) printf(" %16.0f", weightedCost(ops, model));
+        if (custom) printf(" %16.0f", weightedCost(ops, activeCostModel));
+        printf(" %13.2fx\n", weightedCost(ops, activeCostModel) / weightedCost(baseline, activeCostModel));
+    }
+}
+
+struct BenchSuite {
+    const char* name;
+    void (*run)();
+};
+
+// The widest range (2^28 keys, 1 GiB of counts) is over the budget, so the
+// counting rows there show the American flag fallback. Merge sort is the
+// comparison baseline because the quicksorts degrade on this many duplicates.
+void benchCounting() {
+    printf("Counting sort vs comparison and radix sorts by key range (%d hardware threads)\n", hardwareThreads());
+    const int n = 1 << 24;
+    for (int range : {1 << 8, 1 << 16, 1 << 22, 1 << 28}) {
+        std::vector<int> input = randomIntsBelow(n, range, range);
+        WorkStealingPool pool(hardwareThreads());
+        std::vector<int> probe = input;
+        bool fits = countingSort(probe.data(), n);
+        printf(" key range %d%s\n", range, fits ? "" : " (over budget, falls back to American flag)");
+        printBenchRow("Counting Sort (1 thread)", n, timeSortMs([](std::vector<int>& v) { countingSortOrRadix(v.data(), (int)v.size()); }, input), stdSortBaselineMs(input));
+        printBenchRow("Counting Sort (pool)", n, timeSortMs([&](std::vector<int>& v) { countingSortOrRadix(v.data(), (int)v.size(), &pool); }, input), stdSortBaselineMs(input));
+        printBenchRow("American Flag Sort", n, timeSortMs([](std::vector<int>& v) { americanFlagSort(v.data(), (int)v.size()); }, input), stdSortBaselineMs(input));
+        printBenchRow("Merge Sort (bottom-up)", n, timeSortMs([](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }, input), stdSortBaselineMs(input));
+    }
+}
+
+// Few distinct keys leave too few for tags and buffer, so that input shows
+// the rotation-merge fallback.
+void benchBlockMerge() {
+    printf("In-place block merge sort vs buffered merge sort: time and peak extra memory\n");
+    const BenchEntry entries[] = {
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+        {"Block Merge Sort", [](std::vector<int>& v) { blockMergeSort(v.data(), (int)v.size()); }},
+    };
+    for (int n : {1 << 20, 1 << 23}) {
+        for (int distinct : {0, 64}) {
+            std::vector<int> input = distinct ? randomIntsBelow(n, distinct, n) : randomInts(n, n);
+            printf(" %s\n", distinct ? "64 distinct keys" : "random keys");
+            for (const auto& e : entries) {
+                printBenchRow(e.name, n, timeSortMs(e.sort, input), stdSortBaselineMs(input));
+                long long peak = peakExtraMemory(e.sort, input);
+                if (peak >= 0) {
+                    printf("  %-28s %10s  %10.1f MiB peak extra memory\n", "", "", peak / 1048576.0);
+                } else {
+                    printf("  %-28s %10s  peak memory n/a\n", "", "");
+                }
+            }
+        }
+    }
+}
+
+// Merges k sorted runs (split by chunkBegin) of v with `merge` and leaves the
+// result in v.
+template <typename T, typename Merge>
+void mergeRunsWith(std::vector<T>& v, int k, Merge merge) {
+    int n = (int)v.size();
+    std::vector<ArrayRun<T>> runs;
+    for (int i = 0; i < k; ++i) runs.push_back({v.data() + chunkBegin(n, i, k), v.data() + chunkBegin(n, i + 1, k)});
+    std::vector<T> out;
+    out.reserve(n);
+    merge(runs, [&](const T& x) { out.push_back(x); });
+    v.swap(out);
+}
+
+// Comparisons per element come from a second, untimed pass on Counted keys.
+// The linear scan is O(k) per element, so it is timed once and stops at
+// LOSER_BENCH_LINEAR_MAX runs.
+const int LOSER_BENCH_LINEAR_MAX = 256;
+
+void benchLoserTree() {
+    const int n = 1 << 21;
+    printf("k-way merge of %d keys: time and comparisons per element\n", n);
+    printf("  %6s  %24s  %24s  %24s  %12s\n", "k", "linear scan", "binary heap", "loser tree", "std::sort");
+    auto linear = [](auto& runs, auto emit) { linearScanMerge(runs, emit); };
+    auto heap = [](auto& runs, auto emit) { heapMerge(runs, emit); };
+    auto loser = [](auto& runs, auto emit) { loserTreeMerge(runs, emit); };
+    for (int k = 2; k <= 1024; k *= 2) {
+        std::vector<int> input = randomInts(n, k);
+        for (int i = 0; i < k; ++i) std::sort(input.begin() + chunkBegin(n, i, k), input.begin() + chunkBegin(n, i + 1, k));
+        std::vector<Counted> counted;
+        for (int x : input) counted.emplace_back(x);
+        printf("  %6d", k);
+        auto row = [&](auto merge, int reps) {
+            double ms = timeSortMs([&](std::vector<int>& v) { mergeRunsWith(v, k, merge); }, input, reps);
+            std::vector<Counted> c = counted;
+            countedOps = OpCounts();
+            mergeRunsWith(c, k, merge);
+            printf("  %9.2f ms %6.2f cmp/el", ms, (double)countedOps.compares / n);
+        };
+        if (k <= LOSER_BENCH_LINEAR_MAX) {
+            row(linear, 1);
+        } else {
+            printf("  %24s", "skipped");
+        }
+        row(heap, 3);
+        row(loser, 3);
+        printf("  %9.2f ms\n", stdSortBaselineMs(input));
+    }
+}
+
+// Local swaps leave every element near its place; far swaps create small
+// elements near the end ("turtles") that plain bubble passes move back only
+// one step at a time.
+void benchNearlySorted() {
+    const int n = 20000;
+    printf("Bubble family and insertion sort on nearly sorted keys\n");
+    const BenchEntry entries[] = {
+        {"Bubble Sort (all passes)", [](std::vector<int>& v) { bubbleSortAllPasses(v.data(), (int)v.size()); }},
+        {"Bubble Sort (adaptive)", [](std::vector<int>& v) { bubbleSort(v.data(), (int)v.size()); }},
+        {"Cocktail Shaker Sort", [](std::vector<int>& v) { cocktailShakerSort(v.data(), (int)v.size()); }},
+        {"Comb Sort", [](std::vector<int>& v) { combSort(v.data(), (int)v.size()); }},
+        {"Insertion Sort", [](std::vector<int>& v) { insertionSortSwaps(v.data(), (int)v.size()); }},
+        {"Block Quick Sort", [](std::vector<int>& v) { blockQuickSort(v.data(), (int)v.size()); }},
+    };
+    for (const auto& input : presortedInputs(n)) {
+        printf(" %s\n", input.name);
+        for (const auto& e : entries) printBenchRow(e.name, n, timeSortMs(e.sort, input.keys), stdSortBaselineMs(input.keys));
+    }
+}
+
+// The step-based insertion sort swaps adjacent elements (two writes per
+// position); the shifting one and binary insertion sort write once per
+// position moved, and binary insertion does O(log i) comparisons per insert.
+void benchBinaryInsertion() {
+    printf("Binary insertion sort vs insertion sort: time and operation counts, random keys\n");
+    printf("  %-28s %10s  %13s  %12s %12s %12s  %18s\n", "algorithm", "n", "time", "reads", "writes", "compares", "baseline");
+    const CountedBenchEntry entries[] = {
+        {"Insertion Sort (swaps)", [](std::vector<int>& v) { insertionSortSwaps(v.data(), (int)v.size()); },
+         [](Counted* a, int n) { insertionSortSwaps(a, n); }},
+        {"Insertion Sort (shifts)", [](std::vector<int>& v) { insertionSortRange(v.data(), (int)v.size()); },
+         [](Counted* a, int n) { insertionSortRange(a, n); }},
+        {"Binary Insertion Sort", [](std::vector<int>& v) { binaryInsertionSort(v.data(), (int)v.size()); },
+         [](Counted* a, int n) { binaryInsertionSort(a, n); }},
+    };
+    for (int n : {1000, 4000, 16000}) {
+        std::vector<int> input = randomInts(n, n);
+        for (const auto& e : entries) {
+            OpCounts ops = measureKernelCost(e.counted, input);
+            double ms = timeSortMs(e.sort, input);
+            printf("  %-28s %10d  %10.2f ms  %12lld %12lld %12lld  %7.2fx std::sort\n", e.name, n, ms, ops.reads, ops.writes,
+                   ops.compares, ms / stdSortBaselineMs(input));
+        }
+    }
+}
+
+// Heap sort is the non-adaptive in-place reference and the natural merge
+// sort stands in for Timsort (see naturalMergeSort).
+void benchSmoothsort() {
+    const int n = 1 << 20;
+    printf("Smoothsort vs heap sort and natural merge sort on presorted keys\n");
+    printf("  %-28s %10s  %13s  %12s  %18s\n", "algorithm", "n", "time", "compares/n", "baseline");
+    const CountedBenchEntry entries[] = {
+        {"Heap Sort", [](std::vector<int>& v) { heapSort(v.data(), (int)v.size()); }, [](Counted* a, int m) { heapSort(a, m); }},
+        {"Smoothsort", [](std::vector<int>& v) { smoothsort(v.data(), (int)v.size()); }, [](Counted* a, int m) { smoothsort(a, m); }},
+        {"Natural Merge Sort", [](std::vector<int>& v) { naturalMergeSort(v.data(), (int)v.size()); },
+         [](Counted* a, int m) { naturalMergeSort(a, m); }},
+    };
+    for (const auto& input : presortedInputs(n)) {
+        printf(" %s\n", input.name);
+        for (const auto& e : entries) {
+            OpCounts ops = measureKernelCost(e.counted, input.keys);
+            double ms = timeSortMs(e.sort, input.keys);
+            printf("  %-28s %10d  %10.2f ms  %12.2f  %7.2fx std::sort\n", e.name, n, ms, (double)ops.compares / n,
+                   ms / stdSortBaselineMs(input.keys));
+        }
+    }
+}
+
+// The LIS share and the run count are what --analyze reports for a file;
+// the times show how each sort responds to them.
+void benchPatience() {
+    const int n = 1 << 20;
+    printf("Patience sort vs adaptive and plain merge sorts, with each input's LIS and runs\n");
+    const BenchEntry entries[] = {
+        {"Patience Sort", [](std::vector<int>& v) { patienceSort(v.data(), (int)v.size()); }},
+        {"Natural Merge Sort", [](std::vector<int>& v) { naturalMergeSort(v.data(), (int)v.size()); }},
+        {"Smoothsort", [](std::vector<int>& v) { smoothsort(v.data(), (int)v.size()); }},
+        {"Merge Sort", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+    };
+    for (const auto& input : presortedInputs(n)) {
+        int lis = longestSortedSubsequence(input.keys.data(), n);
+        int runs = 1;
+        for (int i = 1; i < n; ++i) runs += input.keys[i] < input.keys[i - 1];
+        printf(" %s: LIS %d (%.2f%%), Rem %d, %d runs\n", input.name, lis, 100.0 * lis / n, n - lis, runs);
+        for (const auto& e : entries) printBenchRow(e.name, n, timeSortMs(e.sort, input.keys), stdSortBaselineMs(input.keys));
+    }
+}
+
+// n is kept small because Lomuto quick sort is quadratic on the fewest
+// keys; the block and SIMD partitions skip keys equal to an earlier pivot.
+void benchFewUnique() {
+    const int n = 1 << 16;
+    printf("Two-way vs three-way quick sort as the number of distinct keys drops\n");
+    const BenchEntry entries[] = {
+        {"Quick Sort (Lomuto)", [](std::vector<int>& v) { lomutoQuickSort(v.data(), (int)v.size()); }},
+        {"Block Quick Sort", [](std::vector<int>& v) { blockQuickSort(v.data(), (int)v.size()); }},
+        {"SIMD Quick Sort", [](std::vector<int>& v) { simdQuickSort(v.data(), (int)v.size(), detectSimdLevel()); }},
+        {"3-Way Quick Sort", [](std::vector<int>& v) { threeWayQuickSort(v.data(), (int)v.size()); }},
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+    };
+    for (int distinct : {n, 1024, 64, 8, 2}) {
+        std::vector<int> input = randomIntsBelow(n, distinct, distinct);
+        printf(" %d distinct keys\n", distinct);
+        for (const auto& e : entries) printBenchRow(e.name, n, timeSortMs(e.sort, input), stdSortBaselineMs(input));
+    }
+}
+
+// Time and comparisons of each selection mode next to the full sort it
+// replaces (3-Way Quick Sort, or Heap Sort for the heap top-k).
+void benchSelect() {
+    const int n = 1 << 20;
+    std::vector<int> input = randomInts(n, 6);
+    auto timeMs = [&](const std::function<void(int*, int)>& run) {
+        double best = 1e300;
+        for (int r = 0; r < 3; ++r) {
+            std::vector<int> v = input;
+            auto start = std::chrono::steady_clock::now();
+            run(v.data(), n);
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+    auto row = [&](const char* name, int k, double ms, double fullMs, const OpCounts& ops, const OpCounts& full) {
+        printf("  %-28s %10d  %10.2f ms  %5.1f%% of the time  %5.1f%% of the compares  %7.2fx std::sort\n", name, k, ms,
+               100.0 * ms / fullMs, 100.0 * ops.compares / full.compares, ms / stdSortBaselineMs(input));
+    };
+    double quickMs = timeMs([](int* a, int m) { threeWayQuickSort(a, m); });
+    double heapMs = timeMs([](int* a, int m) { heapSort(a, m); });
+    OpCounts quick = measureKernelCost([](Counted* a, int m) { threeWayQuickSort(a, m); }, input);
+    OpCounts heap = measureKernelCost([](Counted* a, int m) { heapSort(a, m); }, input);
+    printf("Selection modes vs full sorts, %d random keys (3-Way Quick Sort %.2f ms, Heap Sort %.2f ms)\n", n, quickMs, heapMs);
+    printf("  %-28s %10s  %13s\n", "algorithm", "k", "time");
+    for (int k : {n / 2, n / 100}) {
+        row("Introselect", k, timeMs([k](int* a, int m) { introSelect(a, m, k); }), quickMs,
+            measureKernelCost([k](Counted* a, int m) { introSelect(a, m, k); }, input), quick);
+    }
+    for (int k : {16, n / 1000, n / 100, n / 10}) {
+        row("Partial Quick Sort", k, timeMs([k](int* a, int m) { partialQuickSort(a, m, k); }), quickMs,
+            measureKernelCost([k](Counted* a, int m) { partialQuickSort(a, m, k); }, input), quick);
+        row("Heap Top-K", k, timeMs([k](int* a, int m) { heapTopK(a, m, k); }), heapMs,
+            measureKernelCost([k](Counted* a, int m) { heapTopK(a, m, k); }, input), heap);
+    }
+}
+
+// Comparison counts against the log2(n!) bound, then times with every
+// comparison delayed by --compare-ns (or by a sweep of delays without it):
+// merge-insertion's extra moves are cheap next to slow enough comparisons.
+void benchMergeInsertion() {
+    const int n = 2000;
+    struct Entry {
+        const char* name;
+        void (*counted)(Counted*, int);
+        void (*delayed)(Delayed*, int);
+    };
+    const Entry entries[] = {
+        {"std::sort", [](Counted* a, int m) { std::sort(a, a + m, KeyLess()); }, [](Delayed* a, int m) { std::sort(a, a + m, KeyLess()); }},
+        {"Merge-Insertion Sort", [](Counted* a, int m) { mergeInsertionSort(a, m); }, [](Delayed* a, int m) { mergeInsertionSort(a, m); }},
+        {"Binary Insertion Sort", [](Counted* a, int m) { binaryInsertionSort(a, m); }, [](Delayed* a, int m) { binaryInsertionSort(a, m); }},
+        {"Merge Sort (bottom-up)", [](Counted* a, int m) { bottomUpMergeSort(a, m); }, [](Delayed* a, int m) { bottomUpMergeSort(a, m); }},
+        {"3-Way Quick Sort", [](Counted* a, int m) { threeWayQuickSort(a, m); }, [](Delayed* a, int m) { threeWayQuickSort(a, m); }},
+        {"Heap Sort", [](Counted* a, int m) { heapSort(a, m); }, [](Delayed* a, int m) { heapSort(a, m); }},
+    };
+    std::vector<int> input = randomInts(n, 7);
+    printf("Merge-insertion sort vs other comparison sorts on %d random keys, log2(n!) = %lld compares\n", n, comparisonLowerBound(n));
+    printf("  %-28s %12s %12s %12s\n", "algorithm", "compares", "vs bound", "writes");
+    for (const auto& e : entries) {
+        OpCounts ops = measureKernelCost(e.counted, input);
+        printf("  %-28s %12lld %11.3fx %12lld\n", e.name, ops.compares, (double)ops.compares / comparisonLowerBound(n), ops.writes);
+    }
+    std::vector<long long> delays = {0, 100, 1000};
+    if (compareDelayNs > 0) delays = {compareDelayNs};
+    long long configured = compareDelayNs;
+    for (long long ns : delays) {
+        compareDelayNs = ns;
+        printf(" %lld ns per comparison\n", ns);
+        double baseline = -1;
+        for (const auto& e : entries) {
+            double best = 1e300;
+            for (int r = 0; r < 3; ++r) {
+                std::vector<Delayed> v;
+                for (int x : input) v.push_back({x});
+                auto start = std::chrono::steady_clock::now();
+                e.delayed(v.data(), n);
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            if (baseline < 0) baseline = best;  // std::sort comes first
+            printBenchRow(e.name, n, best, baseline);
+        }
+    }
+    compareDelayNs = configured;
+}
+
+// The standard library sorts next to the fastest sequential and parallel
+// kernels here, on random, nearly sorted and few-unique keys. The parallel
+// kernels use every hardware thread, pool startup included.
+void benchBaseline() {
+    const int n = 1 << 22;
+    printf("Standard library sorts vs the fastest kernels (%d hardware threads)\n", hardwareThreads());
+    const BenchEntry entries[] = {
+        {"std::sort", [](std::vector<int>& v) { runSortKernel(STD_SORT, v.data(), (int)v.size()); }},
+        {"std::stable_sort", [](std::vector<int>& v) { runSortKernel(STD_STABLE_SORT, v.data(), (int)v.size()); }},
+        {"std::sort (par_unseq)", [](std::vector<int>& v) { runSortKernel(STD_PAR_SORT, v.data(), (int)v.size()); }},
+        {"SIMD Quick Sort", [](std::vector<int>& v) { simdQuickSort(v.data(), (int)v.size(), detectSimdLevel()); }},
+        {"3-Way Quick Sort", [](std::vector<int>& v) { threeWayQuickSort(v.data(), (int)v.size()); }},
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+        {"Parallel Merge Sort", [](std::vector<int>& v) {
+             WorkStealingPool pool(hardwareThreads());
+             parallelMergeSort(v.data(), (int)v.size(), pool);
+         }},
+        {"Parallel Sample Sort", [](std::vector<int>& v) {
+             WorkStealingPool pool(hardwareThreads());
+             parallelSampleSort(v.data(), (int)v.size(), pool);
+         }},
+    };
+    const BenchInput inputs[] = {
+        {"random", randomInts(n, 13)},
+        {"1% swaps up to 8 apart", nearlySortedInts(n, n / 100, 8, 13)},
+        {"16 distinct keys", randomIntsBelow(n, 16, 13)},
+    };
+    for (const auto& input : inputs) {
+        printf(" %s\n", input.name);
+        for (const auto& e : entries) {
+#ifndef SORTVIS_PARALLEL_STL
+            if (std::strcmp(e.name, "std::sort (par_unseq)") == 0) {
+                printf("  %-28s %10d  n/a (build with -DSORTVIS_PARALLEL_STL)\n", e.name, n);
+                continue;
+            }
+#endif
+            printBenchRow(e.name, n, timeSortMs(e.sort, input.keys), stdSortBaselineMs(input.keys));
+        }
+    }
+}
+
+// Cache misses per element as n grows: funnelsort against the binary
+// bottom-up merge sort, which misses on every pass once the array leaves the
+// cache, and the cache-aware chunked merge sort (sort cache-sized chunks,
+// then one loser tree merge) tuned for a 32 KiB and a 1 MiB cache. The
+// tuned sorts only do well on the machine they were tuned for; funnelsort
+// needs no parameter. Misses need Linux perf events.
+void benchFunnel() {
+    printf("Funnelsort vs cache-aware and plain merge sorts: time and cache misses\n");
+    const BenchEntry entries[] = {
+        {"Funnelsort", [](std::vector<int>& v) { funnelSort(v.data(), (int)v.size()); }},
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+        {"Chunked Merge (32 KiB)", [](std::vector<int>& v) { chunkedMergeSort(v.data(), (int)v.size(), (32 << 10) / 4); }},
+        {"Chunked Merge (1 MiB)", [](std::vector<int>& v) { chunkedMergeSort(v.data(), (int)v.size(), (1 << 20) / 4); }},
+    };
+    for (int n = 1 << 14; n <= 1 << 22; n <<= 2) {
+        std::vector<int> input = randomInts(n, n);
+        printf(" n = %d (%d KiB)\n", n, n / 256);
+        for (const auto& e : entries) {
+            double ms = timeSortMs(e.sort, input);
+            long long misses = countSortEvents(e.sort, input, EVENT_CACHE_MISSES);
+            printBenchRow(e.name, n, ms, stdSortBaselineMs(input));
+            if (misses >= 0) {
+                printf("  %-28s %10s  %10.3f cache misses per element\n", "", "", (double)misses / n);
+            } else {
+                printf("  %-28s %10s  cache misses n/a (perf events unavailable)\n", "", "");
+            }
+        }
+    }
+}
+
+// Flashsort at several class counts vs comparison and radix sorts on
+// uniform keys and on two skewed distributions: normal keys leave the outer
+// classes sparse, log-normal ones crowd most keys into the first few classes
+// (which then fall back to 3-way quick sort). benchFlash runs one size that
+// fits in cache and one that does not, because the cycle-leader permutation
+// touches a random class per element.
+void benchFlashSize(int n) {
+    std::mt19937 g(12);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::vector<int> normalKeys(n), logNormalKeys(n);
+    for (auto& x : normalKeys) x = (int)(normal(g) * 1e6);
+    for (auto& x : logNormalKeys) x = (int)std::min(1e9, std::exp(3.0 * normal(g)) * 1000);
+    const std::pair<const char*, std::vector<int>> inputs[] = {
+        {"uniform", randomInts(n, 12)}, {"normal", normalKeys}, {"log-normal", logNormalKeys}};
+    const BenchEntry entries[] = {
+        {"Flashsort (m = 0.1n)", [](std::vector<int>& v) { flashSort(v.data(), (int)v.size(), (int)v.size() / 10); }},
+        {"Flashsort (m = 0.43n)", [](std::vector<int>& v) { flashSort(v.data(), (int)v.size(), flashDefaultClasses((int)v.size())); }},
+        {"Flashsort (m = n)", [](std::vector<int>& v) { flashSort(v.data(), (int)v.size(), (int)v.size()); }},
+        {"3-Way Quick Sort", [](std::vector<int>& v) { threeWayQuickSort(v.data(), (int)v.size()); }},
+        {"American Flag Sort", [](std::vector<int>& v) { americanFlagSort(v.data(), (int)v.size()); }},
+        {"Merge Sort (bottom-up)", [](std::vector<int>& v) { bottomUpMergeSort(v.data(), (int)v.size()); }},
+    };
+    for (const auto& input : inputs) {
+        const std::vector<int>& keys = input.second;
+        int lo, hi;
+        keyRange(keys.data(), n, lo, hi);
+        std::vector<int> end = flashClassEnds(keys.data(), n, lo, hi, flashDefaultClasses(n));
+        int largest = end[0];
+        for (size_t k = 1; k < end.size(); ++k) largest = std::max(largest, end[k] - end[k - 1]);
+        printf(" %s keys: largest of %d classes holds %d (%.2f%%)\n", input.first, (int)end.size(), largest, 100.0 * largest / n);
+        for (const auto& e : entries) printBenchRow(e.name, n, timeSortMs(e.sort, keys), stdSortBaselineMs(keys));
+    }
+}
+
+void benchFlash() {
+    printf("Flashsort vs 3-way quick, American flag and merge sort on uniform and skewed keys\n");
+    for (int n : {1 << 18, 1 << 22}) benchFlashSize(n);
+}
+
+const BenchSuite BENCH_SUITES[] = {
+    {"network", benchNetwork},
+    {"oddeven", benchOddEven},
+    {"pmerge", benchParallelMerge},
+    {"sample", benchSampleSort},
+    {"blockqs", benchBlockQuick},
+    {"simdpart", benchSimdPartition},
+    {"simdmerge", benchSimdMerge},
+    {"cutoffs", benchNetworkCutoffs},
+    {"cost", benchCost},
+    {"counting", benchCounting},
+    {"blockmerge", benchBlockMerge},
+    {"losertree", benchLoserTree},
+    {"nearlysorted", benchNearlySorted},
+    {"binsert", benchBinaryInsertion},
+    {"smooth", benchSmoothsort},
+    {"patience", benchPatience},
+    {"fewunique", benchFewUnique},
+    {"select", benchSelect},
+    {"mergeinsert", benchMergeInsertion},
+    {"flash", benchFlash},
+    {"funnel", benchFunnel},
+    {"baseline", benchBaseline},
+};
+
+int runBenchmarks(int argc, char* argv[]) {
+    bool ran = false;
+    for (const auto& suite : BENCH_SUITES) {
+        if (argc > 0 && std::strcmp(argv[0], suite.name) != 0) continue;
+        printf("== %s ==\n", suite.name);
+        suite.run();
+        ran = true;
+    }
+    if (!ran) {
+        printf("Unknown suite '%s'. Available:", argv[0]);
+        for (const auto& suite : BENCH_SUITES) printf(" %s", suite.name);
+        printf("\n");
+        return 1;
+    }
+    return 0;
+}
+
+// File modes
+// Inputs are raw files of native-endian 32-bit ints.
+// `SortingVisualizer --make-input FILE COUNT [DISTINCT]` writes random ones.
+
+const size_t FILE_IO_CHUNK_INTS = 1 << 20;
+
+// "blockquick", "Block Quick Sort", "block-quick" and its SortType index
+// "10" all name BLOCK_QUICK. The selection modes are not full sorts and are
+// not accepted.
+static_assert(BLOCK_QUICK == 10, "update the parseSortType example");
+bool parseSortType(const char* text, SortType& type) {
+    auto normalize = [](const char* s) {
+        std::string out;
+        for (; *s; ++s) {
+            if (std::isalnum((unsigned char)*s)) out += (char)std::tolower((unsigned char)*s);
+        }
+        return out;
+    };
+    std::string wanted = normalize(text);
+    for (int t = 0; t < SORT_COUNT; ++t) {
+        std::string name = normalize(SORT_NAMES[t]);
+        if (!isSelectionMode((SortType)t) && (wanted == name || wanted + "sort" == name || wanted == std::to_string(t))) {
+            type = (SortType)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+int runMakeInput(int argc, char* argv[]) {
+    long long count = argc >= 2 ? std::atoll(argv[1]) : -1;
+    long long distinct = argc >= 3 ? std::atoll(argv[2]) : 0;
+    if (count < 0 || distinct < 0 || distinct > (1LL << 31)) {
+        printf("Usage: --make-input FILE COUNT [DISTINCT]\n");
+        return 1;
+    }
+    FILE* out = std::fopen(argv[0], "wb");
+    if (!out) {
+        printf("Cannot create %s\n", argv[0]);
+        return 1;
+    }
+    std::mt19937 g((unsigned)count);
+    std::uniform_int_distribution<int> dist(0, distinct ? (int)(distinct - 1) : (1 << 30));
+    std::vector<int> chunk(FILE_IO_CHUNK_INTS);
+    bool ok = true;
+    for (long long done = 0; done < count && ok; done += (long long)chunk.size()) {
+        size_t len = (size_t)std::min<long long>((long long)chunk.size(), count - done);
+        for (size_t i = 0; i < len; ++i) chunk[i] = dist(g);
+        ok = std::fwrite(chunk.data(), sizeof(int), len, out) == len;
+    }
+    ok = std::fclose(out) == 0 && ok;
+    if (!ok) printf("Write to %s failed\n", argv[0]);
+    return ok ? 0 : 1;
+}
+
+// `SortingVisualizer --analyze FILE` measures how presorted a file is
+// without sorting it: the LIS from a patience deal that keeps only the pile
+// tops, Rem = n - LIS (the fewest elements to move) and the ascending runs,
+// with what they mean for the merge depth of the adaptive sorts.
+int runAnalyze(int argc, char* argv[]) {
+    if (argc < 1) {
+        printf("Usage: --analyze FILE\n");
+        return 1;
+    }
+    FILE* in = std::fopen(argv[0], "rb");
+    if (!in) {
+        printf("Cannot open %s\n", argv[0]);
+        return 1;
+    }
+    std::vector<int> chunk(FILE_IO_CHUNK_INTS), tops;
+    long long n = 0, runs = 0;
+    int previous = 0;
+    size_t len;
+    while ((len = std::fread(chunk.data(), sizeof(int), chunk.size(), in)) > 0) {
+        for (size_t i = 0; i < len; ++i) {
+            if (n == 0 || chunk[i] < previous) ++runs;
+            previous = chunk[i];
+            ++n;
+            patienceDeal(tops, chunk[i]);
+        }
+    }
+    std::fclose(in);
+    long long lis = (long long)tops.size();
+    int passes = 0;
+    while ((1LL << passes) < runs) ++passes;
+    double percent = 100.0 / std::max(1LL, n);
+    printf("%s: %lld ints\n", argv[0], n);
+    printf("  longest non-decreasing subsequence: %lld (%.2f%%)\n", lis, lis * percent);
+    printf("  Rem, fewest elements to move:       %lld (%.2f%%)\n", n - lis, (n - lis) * percent);
+    printf("  ascending runs:                     %lld (%.1f elements each)\n", runs, (double)n / std::max(1LL, runs));
+    printf("  natural merge sort: at most %d merge passes; patience sort: %lld piles to merge\n",
+           passes, lis);
+    return 0;
+}
+
+// External merge sort
+// `SortingVisualizer --external IN OUT [--budget=MiB] [--sort=NAME]` sorts a
+// file that need not fit in memory. Run generation reads budget-sized chunks,
+// sorts each with the chosen kernel and spills it to an anonymous temporary
+// file. A loser tree then merges the runs with one large read buffer per
+// run and one write buffer, all within the same budget; when there are more
+// runs than buffers of EXTERNAL_MIN_BUFFER fit, extra passes merge groups of
+// runs first. The budget covers the chunk itself, so kernels with linear aux
+// memory (the merge sorts) need up to twice as much.
+const int EXTERNAL_DEFAULT_BUDGET_MIB = 256;
+const size_t EXTERNAL_MIN_BUFFER = 1 << 20;  // bytes
+
+// Sequential reader over a spilled run, refilled a whole buffer at a time.
+struct FileRun {
+    FILE* file;
+    std::vector<int> buffer;
+    size_t pos, len;
+    FileRun(FILE* f, size_t ints) : file(f), buffer(ints), pos(0), len(0) { refill(); }
+    void refill() {
+        len = std::fread(buffer.data(), sizeof(int), buffer.size(), file);
+        pos = 0;
+    }
+    bool empty() const { return pos == len; }
+    const int& head() const { return buffer[pos]; }
+    int pop() {
+        int x = buffer[pos++];
+        if (pos == len) refill();
+        return x;
+    }
+};
+
+struct FileWriter {
+    FILE* file;
+    std::vector<int> buffer;
+    size_t len;
+    bool ok;
+    FileWriter(FILE* f, size_t ints) : file(f), buffer(ints), len(0), ok(true) {}
+    void push(int x) {
+        buffer[len++] = x;
+        if (len == buffer.size()) flush();
+    }
+    void flush() {
+        if (len > 0 && std::fwrite(buffer.data(), sizeof(int), len, file) != len) ok = false;
+        len = 0;
+    }
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printPhase(const char* phase, long long ints, double seconds) {
+    double mb = ints * (double)sizeof(int) / 1e6;
+    printf("%-28s %10.1f MB  %8.2f s  %8.1f MB/s\n", phase, mb, seconds, mb / std::max(seconds, 1e-9));
+}
+
+// Merges `runs` (rewound first) into out with `bufferInts` per buffer.
+bool mergeRunFiles(const std::vector<FILE*>& runs, FILE* out, size_t bufferInts) {
+    std::vector<FileRun> sources;
+    sources.reserve(runs.size());
+    for (FILE* run : runs) {
+        std::rewind(run);
+        sources.emplace_back(run, bufferInts);
+    }
+    FileWriter writer(out, bufferInts);
+    loserTreeMerge(sources, [&](int x) { writer.push(x); });
+    writer.flush();
+    return writer.ok;
+}
+
+bool externalSort(FILE* in, FILE* out, size_t budget, SortType sort) {
+    size_t chunkInts = std::max<size_t>(1024, std::min<size_t>(budget / sizeof(int), 1u << 30));
+    std::vector<FILE*> runs;
+    auto closeRuns = [&]() {
+        for (FILE* run : runs) std::fclose(run);
+        runs.clear();
+    };
+    long long total = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<int> chunk(chunkInts);
+        size_t len;
+        while ((len = std::fread(chunk.data(), sizeof(int), chunkInts, in)) > 0) {
+            auto runStart = std::chrono::steady_clock::now();
+            if (!runSortKernel(sort, chunk.data(), (int)len)) {
+                printf("%s cannot sort a chunk of plain ints\n", SORT_NAMES[sort]);
+                closeRuns();
+                return false;
+            }
+            FILE* run = std::tmpfile();
+            if (!run || std::fwrite(chunk.data(), sizeof(int), len, run) != len) {
+                if (run) std::fclose(run);
+                printf("Cannot spill run %zu to a temporary file\n", runs.size());
+                closeRuns();
+                return false;
+            }
+            runs.push_back(run);
+            total += (long long)len;
+            std::string name = "  run " + std::to_string(runs.size());
+            printPhase(name.c_str(), (long long)len, secondsSince(runStart));
+        }
+    }
+    printPhase("run generation", total, secondsSince(start));
+
+    size_t fanIn = std::max<size_t>(2, budget / EXTERNAL_MIN_BUFFER - 1);
+    for (int pass = 1; runs.size() > fanIn; ++pass) {
+        auto passStart = std::chrono::steady_clock::now();
+        std::vector<FILE*> merged;
+        bool ok = true;
+        for (size_t first = 0; first < runs.size() && ok; first += fanIn) {
+            std::vector<FILE*> group(runs.begin() + first, runs.begin() + std::min(runs.size(), first + fanIn));
+            FILE* run = std::tmpfile();
+            ok = run && mergeRunFiles(group, run, budget / sizeof(int) / (group.size() + 1));
+            if (run) merged.push_back(run);
+        }
+        std::string name = "merge pass " + std::to_string(pass) + " (" + std::to_string(runs.size()) + " -> " +
+                           std::to_string((runs.size() + fanIn - 1) / fanIn) + " runs)";
+        closeRuns();
+        runs = merged;
+        if (!ok) {
+            printf("Cannot write an intermediate run\n");
+            closeRuns();
+            return false;
+        }
+        printPhase(name.c_str(), total, secondsSince(passStart));
+    }
+    auto mergeStart = std::chrono::steady_clock::now();
+    bool ok = mergeRunFiles(runs, out, std::max<size_t>(1024, budget / sizeof(int) / (runs.size() + 1)));
+    std::string name = "final " + std::to_string(runs.size()) + "-way merge";
+    closeRuns();
+    if (!ok) {
+        printf("Write to the output failed\n");
+        return false;
+    }
+    printPhase(name.c_str(), total, secondsSince(mergeStart));
+    printPhase("total", total, secondsSince(start));
+    return true;
+}
+
+int runExternalSort(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: --external IN OUT [--budget=MiB] [--sort=NAME]\n");
+        return 1;
+    }
+    size_t budget = (size_t)EXTERNAL_DEFAULT_BUDGET_MIB << 20;
+    SortType sort = THREE_WAY_QUICK;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--budget=", 9) == 0 && std::atoll(argv[i] + 9) > 0) {
+            budget = (size_t)std::atoll(argv[i] + 9) << 20;
+        } else if (std::strncmp(argv[i], "--sort=", 7) != 0 || !parseSortType(argv[i] + 7, sort)) {
+            printf("Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    FILE* in = std::fopen(argv[0], "rb");
+    if (!in) {
+        printf("Cannot open %s\n", argv[0]);
+        return 1;
+    }
+    FILE* out = std::fopen(argv[1], "wb");
+    if (!out) {
+        printf("Cannot create %s\n", argv[1]);
+        std::fclose(in);
+        return 1;
+    }
+    printf("External merge sort with %s, budget %zu MiB\n", SORT_NAMES[sort], budget >> 20);
+    bool ok = externalSort(in, out, budget, sort);
+    std::fclose(in);
+    ok = std::fclose(out) == 0 && ok;
+    return ok ? 0 : 1;
+}
+
+// Memory-mapped sort
+// `SortingVisualizer --mmap FILE [--sort=NAME]` sorts a raw int file in place
+// through a shared mapping, so the data is never copied into the process.
+// The mapping gets an madvise hint matching the algorithm's access pattern.
+// While a worker thread sorts, the main thread prints a sampled snapshot
+// every MMAP_SNAPSHOT_MS: MMAP_SNAPSHOT_WIDTH evenly spaced elements drawn
+// as glyphs by value, and the share of MMAP_SORTEDNESS_SAMPLES adjacent
+// sample pairs already in order. The samples are relaxed atomic loads, so
+// they may mix old and new values but never tear; they are only displayed.
+const int MMAP_SNAPSHOT_MS = 500;
+const int MMAP_SNAPSHOT_WIDTH = 64;
+const int MMAP_SORTEDNESS_SAMPLES = 4096;
+
+#ifdef __linux__
+struct MmapAdvice {
+    int advice;
+    const char* name;
+};
+
+// Scanning and merging sorts stream through the array, so read-ahead pays
+// (and pages behind can go); cycle-leader permutations jump anywhere, so
+// read-ahead is wasted. Partitioning and the network sorts stay on default.
+MmapAdvice mmapAdviceFor(SortType type) {
+    switch (type) {
+        case BUBBLE:
+        case SELECTION:
+        case INSERTION:
+        case MERGE:
+        case ODD_EVEN:
+        case COUNTING:
+        case BLOCK_MERGE:
+        case FUNNEL:
+        case EXTERNAL: return {MADV_SEQUENTIAL, "MADV_SEQUENTIAL"};
+        case AMERICAN_FLAG:
+        case CYCLE:
+        case FLASH: return {MADV_RANDOM, "MADV_RANDOM"};
+        default: return {MADV_NORMAL, "MADV_NORMAL"};
+    }
+}
+
+// Reads an element the sorter thread may be writing concurrently.
+int sampleElement(const int* a, long long i) {
+    return __atomic_load_n(a + i, __ATOMIC_RELAXED);
+}
+
+void printMmapSnapshot(const int* a, long long n, int lo, int hi, double seconds) {
+    const char glyphs[] = " .:-=+*#%@";
+    const int levels = sizeof(glyphs) - 1;
+    char row[MMAP_SNAPSHOT_WIDTH + 1];
+    for (int i = 0; i < MMAP_SNAPSHOT_WIDTH; ++i) {
+        int x = sampleElement(a, n * i / MMAP_SNAPSHOT_WIDTH);
+        int level = hi > lo ? (int)((long long)(x - (long long)lo) * (levels - 1) / ((long long)hi - lo)) : 0;
+        row[i] = glyphs[std::min(levels - 1, std::max(0, level))];
+    }
+    row[MMAP_SNAPSHOT_WIDTH] = '\0';
+    int inOrder = 0, previous = sampleElement(a, 0);
+    for (int i = 1; i <= MMAP_SORTEDNESS_SAMPLES; ++i) {
+        int x = sampleElement(a, (n - 1) * i / MMAP_SORTEDNESS_SAMPLES);
+        inOrder += previous <= x;
+        previous = x;
+    }
+    printf("%8.2f s  [%s]  %5.1f%% in order\n", seconds, row, 100.0 * inOrder / MMAP_SORTEDNESS_SAMPLES);
+    std::fflush(stdout);
+}
+#endif
+
+int runMmapSort(int argc, char* argv[]) {
+    if (argc < 1) {
+        printf("Usage: --mmap FILE [--sort=NAME]\n");
+        return 1;
+    }
+    SortType sort = THREE_WAY_QUICK;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--sort=", 7) != 0 || !parseSortType(argv[i] + 7, sort)) {
+            printf("Unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+#ifdef __linux__
+    int fd = open(argv[0], O_RDWR);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        printf("Cannot open %s for reading and writing\n", argv[0]);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    long long n = info.st_size / (long long)sizeof(int);
+    if (info.st_size % (long long)sizeof(int) != 0 || n > 0x7fffffff) {
+        printf("%s is not a whole number of ints, or has more than 2^31 - 1\n", argv[0]);
+        close(fd);
+        return 1;
+    }
+    if (n == 0) {
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Cannot map %s\n", argv[0]);
+        return 1;
+    }
+    int* a = (int*)map;
+    MmapAdvice advice = mmapAdviceFor(sort);
+    madvise(map, (size_t)info.st_size, MADV_WILLNEED);
+    madvise(map, (size_t)info.st_size, advice.advice);
+    int lo, hi;
+    keyRange(a, (int)n, lo, hi);
+    printf("Sorting %lld ints of %s in place with %s (%s)\n", n, argv[0], SORT_NAMES[sort], advice.name);
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<bool> done(false);
+    bool ran = false;
+    std::thread sorter([&]() {
+        ran = runSortKernel(sort, a, (int)n);
+        done = true;
+    });
+    auto next = start;
+    while (!done) {
+        printMmapSnapshot(a, n, lo, hi, secondsSince(start));
+        next += std::chrono::milliseconds(MMAP_SNAPSHOT_MS);
+        while (!done && std::chrono::steady_clock::now() < next) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    sorter.join();
+    double sortSeconds = secondsSince(start);
+    printMmapSnapshot(a, n, lo, hi, sortSeconds);
+    if (!ran) printf("%s cannot sort plain ints\n", SORT_NAMES[sort]);
+    bool ok = ran && std::is_sorted(a, a + n);
+    auto syncStart = std::chrono::steady_clock::now();
+    ok = msync(map, (size_t)info.st_size, MS_SYNC) == 0 && ok;
+    printPhase("sort", n, sortSeconds);
+    printPhase("msync", n, secondsSince(syncStart));
+    munmap(map, (size_t)info.st_size);
+    if (!ok) printf("The file is not sorted or could not be synced\n");
+    return ok ? 0 : 1;
+#else
+    printf("--mmap needs Linux\n");
+    return 1;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<char*> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--cost=", 7) == 0) {
+            if (!parseCostModel(argv[i] + 7, activeCostModel)) {
+                printf("Expected --cost=READ,WRITE,COMPARE weights\n");
+                return 1;
+            }
+        } else if (std::strncmp(argv[i], "--compare-ns=", 13) == 0) {
+            compareDelayNs = std::atoll(argv[i] + 13);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (!args.empty() && std::strcmp(args[0], "--bench") == 0) {
+        return runBenchmarks((int)args.size() - 1, args.data() + 1);
+    }
+    if (!args.empty() && std::strcmp(args[0], "--make-input") == 0) {
+        return runMakeInput((int)args.size() - 1, args.data() + 1);
+    }
+    if (!args.empty() && std::strcmp(args[0], "--analyze") == 0) {
+        return runAnalyze((int)args.size() - 1, args.data() + 1);
+    }
+    if (!args.empty() && std::strcmp(args[0], "--external") == 0) {
+        return runExternalSort((int)args.size() - 1, args.data() + 1);
+    }
+    if (!args.empty() && std::strcmp(args[0], "--mmap") == 0) {
+        return runMmapSort((int)args.size() - 1, args.data() + 1);
+    }
     SortingVisualizer visualizer;
     if (!visualizer.init()) {
         SDL_Log("Failed to initialize SDL or window");
@@ -313,4 +5408,7 @@ int main(int argc, char* argv[]) {
 // LEFT/RIGHT: Previous/Next algorithm
 // UP/DOWN: Increase/Decrease speed
 // P: Pause/Resume
+// C: Cycle cost model (reads/writes/compares weights)
+// U: Toggle few-unique input
+// F: Cycle the Flashsort class count
 // ESC: Quit